@@ -0,0 +1,50 @@
+#include "Bench.h"
+
+#include "threadsafe_io.h"
+#include "StringTools.h"
+#include "Timer.h"
+#include "Bitbase.h"
+
+#include <array>
+
+constexpr std::array<const char*, 12> BENCH_POSITIONS = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R2QKB1R w KQ - 0 8",
+    "2kr3r/pp1q1ppp/2n1bn2/3pp3/8/2NP1NP1/PPP1PPBP/R2Q1RK1 w - - 0 11",
+    "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1",
+    "5rk1/1ppb3p/p1pb4/6q1/3P1p1r/2P1R2P/PP1BQ1P1/5RKN w - - 0 1",
+    "8/8/1p1k4/p1p2p2/P1P2P2/1P1K4/8/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+void Bench::RunBench(Worker &w, int depth)
+{
+    Bitbase::WaitForInit();//the node count would otherwise depend on how far generation had got
+    const uint64_t nodes_before = w.leaf_nodes_searched;
+    TimePoint start_time = TimePoint();
+
+    for(const char* fen : BENCH_POSITIONS){
+        sync_cout << "info string bench position " << fen << std::endl;
+
+        w.current_ply_before_search = w.current_board_search_stack;
+        w.repetition_table.Clear();
+        StringTools::ReadFEN(fen, w.current_board, w.current_ply_before_search);
+        w.transposition_table.ClearTable();
+
+        w.stop_condition.store(false);
+        Engine::StartSearch(w, depth, UINT32_MAX);
+    }
+
+    const uint64_t nodes = w.leaf_nodes_searched - nodes_before;
+    const uint64_t time_taken = std::max<uint64_t>(start_time.HowLongAgo(), 1);//prevent division by zero
+
+    sync_cout << "===========================" << std::endl;
+    sync_cout << "Total time (ms) : " << time_taken << std::endl;
+    sync_cout << "Nodes searched  : " << nodes << std::endl;
+    sync_cout << "Nodes/second    : " << (nodes*1000)/time_taken << std::endl;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Engine.h"
+
+namespace Bench
+{
+constexpr int DEFAULT_BENCH_DEPTH = 10;
+
+/**
+ * @brief searches a fixed set of positions to a fixed depth, then prints the total nodes and speed
+ * @note useful for checking that a change to the search doesn't change the node count, or for comparing search settings
+ * @warning overwrites the worker's current position and clears its transposition table
+ */
+void RunBench(Worker& w, int depth);
+
+} // namespace Bench
@@ -0,0 +1,481 @@
+#include "Bitbase.h"
+
+#include "MoveGenerator.h"
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+namespace{
+
+struct EndgameInfo{
+    Piece pieces[2];//pieces the strong side has besides its king
+    int piece_count;
+    bool has_pawn;
+};
+
+constexpr EndgameInfo ENDGAMES[Bitbase::ENDGAME_COUNT] = {
+    {{PieceUtils::QUEEN, PieceUtils::EMPTY}, 1, false},
+    {{PieceUtils::ROOK, PieceUtils::EMPTY}, 1, false},
+    {{PieceUtils::PAWN, PieceUtils::EMPTY}, 1, true},
+    {{PieceUtils::BISHOP, PieceUtils::KNIGHT}, 2, false},
+};
+
+//without pawns, the board can be mirrored and rotated so that the strong king is always in the a1-d1-d4 triangle
+constexpr Square TRIANGLE[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+constexpr int NOT_IN_TRIANGLE = -1;
+
+constexpr std::array<int, 64> CalculateTriangleIndex(){
+    std::array<int, 64> result = {};
+    result.fill(NOT_IN_TRIANGLE);
+    for(int i=0;i<10;i++){
+        result[TRIANGLE[i]] = i;
+    }
+    return result;
+}
+constexpr std::array<int, 64> TRIANGLE_INDEX = CalculateTriangleIndex();
+
+/**
+ * @brief a bitbase position, always with the strong side as white
+ */
+struct Position{
+    Square strong_king;
+    Square weak_king;
+    Square pieces[2];
+    bool strong_to_move;
+};
+
+//what is known about a position during generation, for the side to move
+enum State : uint8_t{
+    UNKNOWN,
+    STATE_WIN,
+    STATE_DRAW,
+    STATE_LOSS,
+    INVALID,
+};
+
+std::vector<uint64_t> won_positions[Bitbase::ENDGAME_COUNT];//1 bit per index, set if the strong side wins
+std::atomic<bool> generated[Bitbase::ENDGAME_COUNT] = {};//set once a table is finished, so that it can be read while others are generated
+std::atomic<bool> kbnk_enabled = false;//KBNK is only generated and probed once it is turned on, as it takes over a minute to generate
+std::jthread background_generation;
+
+size_t TableSize(const EndgameInfo& info){
+    size_t size = 2 * (info.has_pawn ? 64 : 10) * 64;
+    for(int i=0;i<info.piece_count;i++){
+        size *= 64;
+    }
+    return size;
+}
+
+size_t CalculateIndex(const EndgameInfo& info, const Position& pos){
+    size_t index = info.has_pawn ? pos.strong_king : TRIANGLE_INDEX[pos.strong_king];
+    size_t multiplier = info.has_pawn ? 64 : 10;
+
+    index += multiplier * pos.weak_king;
+    multiplier *= 64;
+    for(int i=0;i<info.piece_count;i++){
+        index += multiplier * pos.pieces[i];
+        multiplier *= 64;
+    }
+    return 2*index + pos.strong_to_move;
+}
+
+Position DecodeIndex(const EndgameInfo& info, size_t index){
+    Position pos;
+    pos.strong_to_move = index & 1;
+    index /= 2;
+
+    const size_t king_squares = info.has_pawn ? 64 : 10;
+    pos.strong_king = info.has_pawn ? index % 64 : TRIANGLE[index % 10];
+    index /= king_squares;
+
+    pos.weak_king = index % 64;
+    index /= 64;
+    for(int i=0;i<info.piece_count;i++){
+        pos.pieces[i] = index % 64;
+        index /= 64;
+    }
+    return pos;
+}
+
+/**
+ * @brief applies a transformation to every square in the position
+ */
+template<typename Transform>
+void TransformPosition(Position& pos, int piece_count, Transform transform){
+    pos.strong_king = transform(pos.strong_king);
+    pos.weak_king = transform(pos.weak_king);
+    for(int i=0;i<piece_count;i++){
+        pos.pieces[i] = transform(pos.pieces[i]);
+    }
+}
+
+/**
+ * @brief works out which bitbase the board belongs to, and where in it
+ * @returns ENDGAME_COUNT if the board is not covered by any bitbase
+ */
+Bitbase::Endgame Canonicalise(const Board& board, Position& pos){
+    const Bitboard white_extra = board.colour_bitboard[1] & ~board.piece_bitboard[PieceUtils::KING];
+    const Bitboard black_extra = board.colour_bitboard[0] & ~board.piece_bitboard[PieceUtils::KING];
+    if((white_extra != 0) == (black_extra != 0)){
+        return Bitbase::ENDGAME_COUNT;//bare kings, or both sides have material
+    }
+
+    const bool strong_is_white = white_extra != 0;
+    Bitboard extra = strong_is_white ? white_extra : black_extra;
+    const int piece_count = BitboardUtils::PopCount(extra);
+    if(piece_count > 2){
+        return Bitbase::ENDGAME_COUNT;
+    }
+
+    pos.strong_king = BitboardUtils::FindLSB(board.piece_bitboard[PieceUtils::KING] & board.colour_bitboard[strong_is_white]);
+    pos.weak_king = BitboardUtils::FindLSB(board.piece_bitboard[PieceUtils::KING] & board.colour_bitboard[!strong_is_white]);
+    pos.strong_to_move = board.turn == strong_is_white;
+
+    //find the endgame, putting the pieces in the same order as the table
+    Bitbase::Endgame endgame = Bitbase::ENDGAME_COUNT;
+    for(int e=0;e<Bitbase::ENDGAME_COUNT;e++){
+        const EndgameInfo& info = ENDGAMES[e];
+        if(info.piece_count != piece_count){
+            continue;
+        }
+        bool matches = true;
+        Bitboard remaining = extra;
+        for(int i=0;i<info.piece_count;i++){
+            const Bitboard piece_bb = remaining & board.piece_bitboard[info.pieces[i]];
+            if(piece_bb == 0){
+                matches = false;
+                break;
+            }
+            pos.pieces[i] = BitboardUtils::FindLSB(piece_bb);
+            remaining &= ~BitboardUtils::MakeBitBoard(pos.pieces[i]);
+        }
+        if(matches){
+            endgame = (Bitbase::Endgame)e;
+            break;
+        }
+    }
+    if(endgame == Bitbase::ENDGAME_COUNT){
+        return Bitbase::ENDGAME_COUNT;
+    }
+    const EndgameInfo& info = ENDGAMES[endgame];
+
+    //make white the strong side, by flipping the board vertically
+    if(!strong_is_white){
+        TransformPosition(pos, info.piece_count, [](Square s){return s ^ 56;});
+    }
+
+    if(info.has_pawn){
+        if(SquareUtils::ToFile(pos.pieces[0]) > 3){
+            TransformPosition(pos, info.piece_count, [](Square s){return s ^ 7;});//mirror so the pawn is on files a-d
+        }
+        return endgame;
+    }
+
+    //move the strong king into the a1-d1-d4 triangle
+    if(SquareUtils::ToFile(pos.strong_king) > 3){
+        TransformPosition(pos, info.piece_count, [](Square s){return s ^ 7;});
+    }
+    if(SquareUtils::ToRank(pos.strong_king) > 3){
+        TransformPosition(pos, info.piece_count, [](Square s){return s ^ 56;});
+    }
+    if(SquareUtils::ToRank(pos.strong_king) > SquareUtils::ToFile(pos.strong_king)){
+        TransformPosition(pos, info.piece_count, [](Square s){return (Square)(((s & 7) << 3) | (s >> 3));});//flip along the a1-h8 diagonal
+    }
+    assert(TRIANGLE_INDEX[pos.strong_king] != NOT_IN_TRIANGLE);
+    return endgame;
+}
+
+/**
+ * @brief checks the parts of legality that don't need a board
+ */
+bool IsPlausible(const EndgameInfo& info, const Position& pos){
+    Bitboard occupied = BitboardUtils::MakeBitBoard(pos.strong_king) | BitboardUtils::MakeBitBoard(pos.weak_king);
+    for(int i=0;i<info.piece_count;i++){
+        occupied |= BitboardUtils::MakeBitBoard(pos.pieces[i]);
+    }
+    if((int)BitboardUtils::PopCount(occupied) != info.piece_count + 2){
+        return false;//pieces on the same square
+    }
+    if(SquareUtils::ChebyshevDistance(pos.strong_king, pos.weak_king) <= 1){
+        return false;//kings touching
+    }
+    if(info.has_pawn){
+        const Square pawn = pos.pieces[0];
+        if(SquareUtils::ToRank(pawn) == 0 || SquareUtils::ToRank(pawn) == 7 || SquareUtils::ToFile(pawn) > 3){
+            return false;//pawns can't be on the back ranks, and the mirrored files are never used
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief clears the board and puts the position on it, with white as the strong side
+ * @note the neural network is not updated, as generation never evaluates a position
+ */
+void SetUpBoard(Board& board, SearchUtils::PlyData* ply_data, const EndgameInfo& info, const Position& pos){
+    for(Square s=0;s<64;s++){
+        board.squares[s] = PieceUtils::EMPTY;
+    }
+    board.colour_bitboard[0] = board.colour_bitboard[1] = 0;
+    for(int i=0;i<6;i++){
+        board.piece_bitboard[i] = 0;
+    }
+
+    auto place = [&board](Square s, Piece p){
+        board.squares[s] = p;
+        board.colour_bitboard[PieceUtils::IsWhite(p)] |= BitboardUtils::MakeBitBoard(s);
+        board.piece_bitboard[PieceUtils::BasePiece(p)] |= BitboardUtils::MakeBitBoard(s);
+    };
+    place(pos.strong_king, PieceUtils::KING + PieceUtils::WHITE_FLAG);
+    place(pos.weak_king, PieceUtils::KING);
+    for(int i=0;i<info.piece_count;i++){
+        place(pos.pieces[i], info.pieces[i] + PieceUtils::WHITE_FLAG);
+    }
+
+    board.turn = pos.strong_to_move;
+    ply_data->enpessant = SquareUtils::NULL_SQUARE;
+    ply_data->castling_rights = 0;
+    ply_data->fifty_move_rule = 0;
+    ply_data->zobrist = 0;
+    ply_data->ply_from_root = 0;
+}
+
+/**
+ * @brief finds what is known about the board, for the side to move
+ */
+State LookUpState(const Board& board, Bitbase::Endgame generating, const std::vector<uint8_t>& states){
+    Position pos;
+    const Bitbase::Endgame endgame = Canonicalise(board, pos);
+
+    if(endgame == generating){
+        return (State)states[CalculateIndex(ENDGAMES[endgame], pos)];
+    }
+    switch(Bitbase::Probe(board)){
+        case Bitbase::WIN: return STATE_WIN;
+        case Bitbase::LOSS: return STATE_LOSS;
+        default: return STATE_DRAW;//captured down to bare kings or a lone minor piece, or underpromoted
+    }
+}
+
+/**
+ * @brief retrograde analysis, by repeatedly looking one move ahead until nothing changes
+ * positions still unknown at the end can never be forced into a win, so are draws
+ * @returns false if stop was requested before the table was finished
+ */
+bool Generate(Bitbase::Endgame endgame, std::stop_token stop = {}){
+    const EndgameInfo& info = ENDGAMES[endgame];
+    const size_t size = TableSize(info);
+
+    won_positions[endgame].assign((size+63)/64, 0);
+    std::vector<uint8_t> states(size, UNKNOWN);
+
+    Board board;
+    SearchUtils::PlyData ply_data[2];
+    Move move_list[MoveGenerator::MAX_MOVE_COUNT];
+
+    bool first_pass = true;
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(size_t index=0;index<size;index++){
+            if(states[index] != UNKNOWN){
+                continue;
+            }
+            if(stop.stop_requested()){
+                return false;
+            }
+
+            const Position pos = DecodeIndex(info, index);
+            if(first_pass){
+                if(!IsPlausible(info, pos)){
+                    states[index] = INVALID;
+                    continue;
+                }
+                SetUpBoard(board, ply_data, info, pos);
+                board.turn = !board.turn;
+                const bool can_capture_king = MoveGenerator::InCheck(board);
+                board.turn = !board.turn;
+                if(can_capture_king){
+                    states[index] = INVALID;
+                    continue;
+                }
+            } else {
+                SetUpBoard(board, ply_data, info, pos);
+            }
+
+            Move* end = board.turn ? MoveGenerator::GenerateMain<true, MoveGenerator::ALL_MOVES>(board, ply_data, move_list) : MoveGenerator::GenerateMain<false, MoveGenerator::ALL_MOVES>(board, ply_data, move_list);
+            if(end == move_list){
+                states[index] = ply_data->in_check ? STATE_LOSS : STATE_DRAW;//checkmate or stalemate
+                changed = true;
+                continue;
+            }
+
+            //the strong side can only win or draw, and the bare king can only lose or draw, so stop looking as soon as the result is clear
+            State result = UNKNOWN;
+            if(pos.strong_to_move){
+                bool all_children_drawn = true;
+                for(Move* m = move_list; m != end; m++){
+                    BoardUtils::MakeMove(board, *m, ply_data);
+                    const State child = LookUpState(board, endgame, states);
+                    BoardUtils::UnMakeMove(board, *m, ply_data);
+
+                    if(child == STATE_LOSS){
+                        result = STATE_WIN;
+                        break;
+                    }
+                    all_children_drawn &= child == STATE_DRAW;
+                }
+                if(result == UNKNOWN && all_children_drawn){
+                    result = STATE_DRAW;
+                }
+            } else {
+                result = STATE_LOSS;//unless any move escapes
+                for(Move* m = move_list; m != end; m++){
+                    BoardUtils::MakeMove(board, *m, ply_data);
+                    const State child = LookUpState(board, endgame, states);
+                    BoardUtils::UnMakeMove(board, *m, ply_data);
+
+                    if(child != STATE_WIN){
+                        result = child == STATE_DRAW ? STATE_DRAW : UNKNOWN;
+                        break;
+                    }
+                }
+            }
+
+            if(result != UNKNOWN){
+                states[index] = result;
+                changed = true;
+            }
+        }
+        first_pass = false;
+    }
+
+    for(size_t index=0;index<size;index++){
+        const bool strong_to_move = index & 1;
+        const bool won = states[index] == (strong_to_move ? STATE_WIN : STATE_LOSS);
+        if(won){
+            won_positions[endgame][index/64] |= 1ULL << (index%64);
+        }
+    }
+    generated[endgame].store(true, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief generates every enabled bitbase that isn't finished yet, in order of dependency as pawns promote
+ */
+void GenerateMissing(std::stop_token stop){
+    for(Bitbase::Endgame endgame : {Bitbase::KQK, Bitbase::KRK, Bitbase::KPK, Bitbase::KBNK}){
+        if(Bitbase::IsGenerated(endgame) || (endgame == Bitbase::KBNK && !kbnk_enabled.load())){
+            continue;
+        }
+        if(!Generate(endgame, stop)){
+            return;
+        }
+    }
+}
+
+/**
+ * @brief how far the square is from the middle 4 squares, in king moves along each axis added together
+ */
+int CentreDistance(Square s){
+    const int file = SquareUtils::ToFile(s);
+    const int rank = SquareUtils::ToRank(s);
+    return std::max(3-file, file-4) + std::max(3-rank, rank-4);
+}
+
+}
+
+void Bitbase::Init()
+{
+    GenerateMissing({});
+}
+
+void Bitbase::InitInBackground()
+{
+    background_generation = std::jthread(GenerateMissing);
+}
+
+void Bitbase::WaitForInit()
+{
+    if(background_generation.joinable()){
+        background_generation.join();
+    }
+}
+
+void Bitbase::CancelInit()
+{
+    background_generation.request_stop();
+    WaitForInit();
+}
+
+void Bitbase::SetKBNKEnabled(bool enabled)
+{
+    kbnk_enabled.store(enabled);
+    background_generation = std::jthread(GenerateMissing);//stops any generation in progress, then carries on with KBNK included or left out
+}
+
+bool Bitbase::IsGenerated(Endgame endgame)
+{
+    return generated[endgame].load(std::memory_order_acquire);
+}
+
+Bitbase::Result Bitbase::Probe(const Board &board)
+{
+    if(BitboardUtils::PopCount(board.colour_bitboard[0] | board.colour_bitboard[1]) > 4){
+        return NO_RESULT;//fast path for nearly every position
+    }
+
+    Position pos;
+    const Endgame endgame = Canonicalise(board, pos);
+    if(endgame == ENDGAME_COUNT || !IsGenerated(endgame) || (endgame == KBNK && !kbnk_enabled.load(std::memory_order_relaxed))){
+        return NO_RESULT;
+    }
+
+    const size_t index = CalculateIndex(ENDGAMES[endgame], pos);
+    const bool won = won_positions[endgame][index/64] & (1ULL << (index%64));
+    if(!won){
+        return DRAW;
+    }
+    return pos.strong_to_move ? WIN : LOSS;
+}
+
+Evaluation Bitbase::ResultToScore(const Board &board, Result result)
+{
+    assert(result != NO_RESULT);
+    if(result == DRAW){
+        return 0;
+    }
+
+    Position pos;
+    const Endgame endgame = Canonicalise(board, pos);
+    assert(endgame != ENDGAME_COUNT);
+    const EndgameInfo& info = ENDGAMES[endgame];
+
+    Evaluation score = KNOWN_WIN;
+    for(int i=0;i<info.piece_count;i++){
+        score += Eval::PIECE_VALUES[info.pieces[i]];
+    }
+
+    if(info.has_pawn){
+        score += 20 * SquareUtils::ToRank(pos.pieces[0]);//push the pawn
+    } else {
+        //drive the bare king to the edge, and bring the other king closer to help
+        score += 10 * CentreDistance(pos.weak_king);
+        score += 10 * (7 - SquareUtils::ChebyshevDistance(pos.strong_king, pos.weak_king));
+    }
+
+    if(endgame == KBNK){
+        //only the corners the bishop can cover are mates
+        const Square bishop = pos.pieces[0];
+        const bool dark_bishop = (SquareUtils::ToFile(bishop) + SquareUtils::ToRank(bishop)) % 2 == 0;
+        const Square corner_a = dark_bishop ? 0 : 56;
+        const Square corner_b = dark_bishop ? 63 : 7;
+        const int corner_distance = std::min(SquareUtils::ChebyshevDistance(pos.weak_king, corner_a), SquareUtils::ChebyshevDistance(pos.weak_king, corner_b));
+        score += 20 * (7 - corner_distance);
+    }
+
+    return result == WIN ? score : -score;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Board.h"
+#include "Eval.h"
+
+/**
+ * win/draw/loss tables for a few small endgames, generated in memory by retrograde analysis
+ * only endgames where one side has a bare king are covered, so the bare king side can never win
+ */
+namespace Bitbase
+{
+
+enum Endgame{
+    KQK,
+    KRK,
+    KPK,//needs KQK and KRK to already exist, for promotions
+    KBNK,
+    ENDGAME_COUNT,
+};
+
+enum Result{
+    NO_RESULT,//position is not covered by any generated bitbase
+    WIN,
+    DRAW,
+    LOSS,
+};
+
+//well below any mate score, but above anything the evaluation would give
+constexpr Evaluation KNOWN_WIN = 10'000;
+
+/**
+ * @brief generates the KQK, KRK and KPK bitbases, which takes about a second
+ */
+void Init();
+
+/**
+ * @brief runs Init on another thread, so that the engine can answer commands straight away
+ * @note each bitbase gives NO_RESULT until it has been generated
+ */
+void InitInBackground();
+
+/**
+ * @brief blocks until the generation started by InitInBackground has finished, for when results must not depend on timing
+ */
+void WaitForInit();
+
+/**
+ * @brief stops the generation started by InitInBackground, leaving any unfinished bitbases ungenerated
+ * @note must be called before exiting, as the generation uses tables that are freed on exit
+ */
+void CancelInit();
+
+/**
+ * @brief turns probing of the KBNK bitbase, which is far bigger and slower to generate than the others, on or off
+ * @note the first time it is turned on, it is generated on the same thread as InitInBackground, and gives NO_RESULT until it is finished
+ */
+void SetKBNKEnabled(bool enabled);
+
+/**
+ * @returns true if the bitbase for this endgame has been generated, and can be probed from any thread
+ */
+bool IsGenerated(Endgame endgame);
+
+/**
+ * @brief looks up the position in the generated bitbases
+ * @returns the result for the side to move, or NO_RESULT
+ * @note enpessant and castling are ignored, as the bare king side has no pawns, and castling is impossible with so little material
+ */
+Result Probe(const Board& board);
+
+/**
+ * @brief converts a bitbase result into a score for the side to move
+ * @note wins are scored as KNOWN_WIN plus material and a bonus for making progress, so the search still heads towards mate
+ */
+Evaluation ResultToScore(const Board& board, Result result);
+
+} // namespace Bitbase
@@ -3,14 +3,46 @@
 #include "Eval.h"
 #include "MoveGenerator.h"
 #include "threadsafe_io.h"
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cassert>
+#include <iomanip>
 #include "StringTools.h"
 #include "Timer.h"
 #include "Board.h"
 #include "MoveSorting.h"
 #include "TranspositionTable.h"
+#include "Bitbase.h"
+
+#ifdef SEARCH_STATS
+namespace{
+uint64_t NanosecondsNow(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+#endif
+
+/**
+ * @brief generates moves for whoever's turn it is, timing it if collecting stats
+ */
+template<MoveGenerator::GenType gen_type>
+Move* Worker::GenerateMoves(SearchUtils::PlyData *ply_data, Move *move_list){
+    STATS_ONLY(const uint64_t start_ns = NanosecondsNow();)
+    Move* end = current_board.turn ? MoveGenerator::GenerateMain<true, gen_type>(current_board, ply_data, move_list) : MoveGenerator::GenerateMain<false, gen_type>(current_board, ply_data, move_list);
+    STATS_ONLY(detailed_stats.movegen_ns += NanosecondsNow() - start_ns;)
+    return end;
+}
+
+/**
+ * @brief evaluates the current board, timing it if collecting stats
+ */
+Evaluation Worker::StaticEval(){
+    STATS_ONLY(const uint64_t start_ns = NanosecondsNow();)
+    const Evaluation result = Eval::EvaluateBoard(current_board);
+    STATS_ONLY(detailed_stats.eval_ns += NanosecondsNow() - start_ns;)
+    return result;
+}
 
 /**
  * @brief the main search function
@@ -19,12 +51,17 @@ void Worker::RootSearch(int max_depth, SearchUtils::PlyData* ply_data){
     if(max_depth == 0){
         //want just a qsearch score
         Evaluation qscore = Quiescence(Engine::QUIESCENCE_DEPTH, ply_data, Eval::START_NEGATIVE, -Eval::START_NEGATIVE);
-        sync_cout << "info score " << qscore << std::endl;
-        sync_cout << "bestmove " << StringTools::MoveToString(MoveUtils::NULL_MOVE) << std::endl;
+        last_result = {MoveUtils::NULL_MOVE, qscore, 0, SearchNodes(), "", ElapsedMs()};
+        if(print_info){
+            sync_cout << "info score " << qscore << std::endl;
+            sync_cout << "bestmove " << StringTools::MoveToString(MoveUtils::NULL_MOVE) << std::endl;
+        }
         return;
     }
 
     Move safe_best_move = MoveUtils::NULL_MOVE;//this move is the latest safe move we have
+    last_result = SearchResult();
+    iteration_results.clear();
 
     ply_data->ply_from_root=0;//currently at ply 0
 
@@ -35,11 +72,13 @@ void Worker::RootSearch(int max_depth, SearchUtils::PlyData* ply_data){
 
         assert(alpha < beta);
 
+        STATS_ONLY(const uint64_t nodes_before_iteration = detailed_stats.interior_nodes + detailed_stats.qsearch_nodes;)
+        const uint64_t iteration_start_nodes = SearchNodes();
         Evaluation current_iteration_eval = NegaMax<ROOT>(curr_depth, ply_data, alpha, beta, 0, true);
         Move current_iteration_move = ply_data->best_move;
 
-        if(current_iteration_eval == Eval::NULL_EVAL && curr_depth >= 5){
-            //move is forced (one possible reply)
+        if(current_iteration_eval == Eval::NULL_EVAL){
+            //move is forced (one possible reply). no nodes are searched, so without stopping here a node or depth limited search would never end
             safe_best_move = current_iteration_move;
             break;
         }
@@ -64,12 +103,29 @@ void Worker::RootSearch(int max_depth, SearchUtils::PlyData* ply_data){
         }
         assert(current_iteration_eval < beta && current_iteration_eval > alpha);
         
-        sync_cout << "info depth " << curr_depth << 
-        " pv " << FindPV(ply_data) << //trailing space included!
-        "score " << StringTools::ScoreToString(current_iteration_eval) << 
-        " hashfull " << transposition_table.CalculatePerMilFull() <<
-        " nodes " << leaf_nodes_searched << 
-            std::endl;
+        last_result.pv = FindPV(ply_data);
+        if(print_info){
+            const uint64_t elapsed_ms = ElapsedMs();
+            const uint64_t nodes = SearchNodes();
+            sync_cout << "info depth " << curr_depth <<
+            " seldepth " << selective_depth <<
+            " score " << StringTools::ScoreToString(current_iteration_eval) <<
+            " nodes " << nodes <<
+            " nps " << nodes*1000 / std::max<uint64_t>(elapsed_ms, 1) <<
+            " hashfull " << transposition_table.CalculatePerMilFull() <<
+            " time " << elapsed_ms <<
+            " pv " << last_result.pv <<
+                std::endl;
+            next_heartbeat = TimePoint(Engine::HEARTBEAT_INTERVAL_MS);//a full info line was just sent
+        }
+        last_result.score = current_iteration_eval;
+        last_result.depth = curr_depth;
+        if(record_iterations){
+            last_result.best_move = current_iteration_move;
+            last_result.nodes = SearchNodes();
+            last_result.time_ms = ElapsedMs();
+            iteration_results.push_back(last_result);
+        }
 
         assert(current_iteration_eval != Eval::NULL_EVAL);
         //set aspiration window
@@ -83,9 +139,45 @@ void Worker::RootSearch(int max_depth, SearchUtils::PlyData* ply_data){
         assert(beta <= -Eval::START_NEGATIVE);
 
         safe_best_move = current_iteration_move;//iteration complete, I can safely overwrite the previous result
+        STATS_ONLY(
+            detailed_stats.previous_iteration_nodes = detailed_stats.last_iteration_nodes;
+            detailed_stats.last_iteration_nodes = detailed_stats.interior_nodes + detailed_stats.qsearch_nodes - nodes_before_iteration;
+        )
         curr_depth += 1;//successful search, increase depth
+
+        if(mate_search_moves != 0 && current_iteration_eval >= Eval::FURTHEST_MATE){
+            const int mate_moves = (Eval::CHECKMATE_WIN - current_iteration_eval + 1)/2;//mate ply to moves, like StringTools::ScoreToString
+            if(mate_moves <= mate_search_moves){
+                break;//found a short enough mate
+            }
+        }
+
+        if(SearchNodes() == iteration_start_nodes){
+            break;//the whole iteration came from the TT (like after finding a mate), so every deeper one would too, and a node limit would never be reached
+        }
     }
     stop_condition.store(true);
+    last_result.best_move = safe_best_move;
+    last_result.nodes = SearchNodes();
+    last_result.time_ms = ElapsedMs();
+    if(!print_info){
+        return;
+    }
+    STATS_ONLY(
+        sync_cout << "info string prunes" <<
+        " rfp " << search_stats.reverse_futility_prunes <<
+        " razor " << search_stats.razor_prunes <<
+        " futility " << search_stats.futility_prunes <<
+        " lmp " << search_stats.late_move_prunes <<
+        " singular " << search_stats.singular_extensions <<
+        " multicut " << search_stats.multi_cuts <<
+        " iir " << search_stats.internal_iterative_reductions <<
+        " iid " << search_stats.internal_iterative_searches <<
+        " delta " << search_stats.delta_prunes <<
+        " bitbase " << search_stats.bitbase_hits <<
+            std::endl;
+    )
+    STATS_ONLY(PrintDetailedStats();)
     sync_cout << "bestmove " << StringTools::MoveToString(safe_best_move) << std::endl;
 }
 
@@ -100,23 +192,74 @@ Evaluation Worker::NegaMax(int depth, SearchUtils::PlyData *ply_data, Evaluation
         return Quiescence(Engine::QUIESCENCE_DEPTH, ply_data, alpha, beta);
     }
     ply_data->best_move = MoveUtils::NULL_MOVE;
+    STATS_ONLY(detailed_stats.interior_nodes++;)
+    selective_depth = std::max(selective_depth, ply_data->ply_from_root);
 
-    if(SearchUtils::IsDraw(ply_data) && node_type != NodeType::ROOT){//is this right?
+    if(node_type != NodeType::ROOT && (ply_data->fifty_move_rule >= 100 || repetition_table.IsRepetition(ply_data->zobrist, ply_data->fifty_move_rule))){
         return 0;//draw by 50 move or repetition
     }
 
+    if(node_type != NodeType::ROOT){
+        //mate distance pruning: even mating on the next move can't beat a shorter mate found elsewhere
+        const Evaluation mated_now = Eval::MakeMatedEvaluation(ply_data->ply_from_root);
+        const Evaluation mate_next_move = -Eval::MakeMatedEvaluation(ply_data->ply_from_root+1);
+        if(mated_now >= beta){
+            return beta;
+        }
+        if(mate_next_move <= alpha){
+            return alpha;
+        }
+        alpha = std::max(alpha, mated_now);
+        beta = std::min(beta, mate_next_move);
+    }
+    if(node_type != NodeType::ROOT && ply_data->fifty_move_rule == 0){
+        //only probe straight after a capture or pawn move, so that the search can still find the way to mate inside the endgame
+        const Bitbase::Result bitbase_result = Bitbase::Probe(current_board);
+        if(bitbase_result != Bitbase::NO_RESULT){
+            search_stats.bitbase_hits++;
+            return std::clamp(Bitbase::ResultToScore(current_board, bitbase_result), alpha, beta);
+        }
+    }
+
+    const bool is_singular_search = ply_data->excluded_move != MoveUtils::NULL_MOVE;//the entry for this position is for a search without the excluded move, so don't use it
+
     TTEntry tt_result = transposition_table.ProbeAdjusted(ply_data->zobrist, depth, ply_data->ply_from_root, alpha, beta);
-    if(tt_result.score != Eval::NULL_EVAL){
+    STATS_ONLY(
+        detailed_stats.tt_probes++;
+        detailed_stats.tt_hits += tt_result.zobrist_hash == ply_data->zobrist;
+    )
+    if(tt_result.score != Eval::NULL_EVAL && !is_singular_search){
         assert(tt_result.score <= Eval::CHECKMATE_WIN && tt_result.score >= -Eval::CHECKMATE_WIN);
+        STATS_ONLY(detailed_stats.tt_cutoffs++;)
         ply_data->best_move = tt_result.best_move;
         return tt_result.score;
     }
 
+    Move tt_move = tt_result.best_move;
+    const bool has_search_tt_move = tt_move != MoveUtils::NULL_MOVE && tt_result.subtree_depth > TranspositionUtils::QSEARCH_DEPTH;//a qsearch best move only covers captures, so it doesn't stand in for a searched move
+    if(node_type != NodeType::ROOT && !has_search_tt_move && !is_singular_search && depth >= Engine::INTERNAL_ITERATIVE_MIN_DEPTH){
+        switch(search_params.internal_iterative_mode){
+            case Engine::INTERNAL_ITERATIVE_REDUCTION:
+                search_stats.internal_iterative_reductions++;
+                depth--;
+                break;
+            case Engine::INTERNAL_ITERATIVE_DEEPENING:
+                search_stats.internal_iterative_searches++;
+                NegaMax<NodeType::NORMAL>(depth-Engine::IID_REDUCTION, ply_data, alpha, beta, previous_extensions, allow_null);
+                tt_move = ply_data->best_move;
+                ply_data->best_move = MoveUtils::NULL_MOVE;
+                if(stop_condition.load(std::memory_order_relaxed)){
+                    return 0;//out of time
+                }
+                break;
+        }
+    }
+
     TTLookupType score_type = TTLookupType::UPPERBOUND;//result from this search starts as being an exact score
 
     Move move_list[MoveGenerator::MAX_MOVE_COUNT];
     int move_scores[MoveGenerator::MAX_MOVE_COUNT];
-    Move* end = current_board.turn ? MoveGenerator::GenerateMain<true, false>(current_board, ply_data, move_list) : MoveGenerator::GenerateMain<false, false>(current_board, ply_data, move_list);
+    Move* end = GenerateMoves<MoveGenerator::ALL_MOVES>(ply_data, move_list);
     int legal_move_count = end - move_list;
 
     if (node_type == NodeType::ROOT && legal_move_count == 1){
@@ -126,7 +269,7 @@ Evaluation Worker::NegaMax(int depth, SearchUtils::PlyData *ply_data, Evaluation
     }
 
     if(legal_move_count == 0){
-        assert(tt_result.best_move == MoveUtils::NULL_MOVE);
+        assert(tt_move == MoveUtils::NULL_MOVE);
         if(ply_data->in_check){
             assert(ply_data->ply_from_root >= 0);
             return Eval::MakeMatedEvaluation(ply_data->ply_from_root);//enemy checkmated me
@@ -136,55 +279,154 @@ Evaluation Worker::NegaMax(int depth, SearchUtils::PlyData *ply_data, Evaluation
 
     if(leaf_nodes_searched % 2048 == 0){
         UpdateTimer();
+        PrintHeartbeat();
     }
 
     Evaluation curr_score;
 
+    const bool is_pv = beta - alpha > 1;//a full window means this node could end up on the pv
+    const bool can_forward_prune = node_type != NodeType::ROOT && !is_pv && !ply_data->in_check && !is_singular_search && mate_search_moves == 0;//eval based pruning can't prove a mate
+
+    //the static eval is only needed by the pruning near the leaves
+    const Evaluation static_eval = can_forward_prune && depth <= Engine::RFP_MAX_DEPTH ? StaticEval() : Eval::NULL_EVAL;
+    const bool has_static_eval = static_eval != Eval::NULL_EVAL;
+
+    //reverse futility pruning
+    if(has_static_eval && beta < Eval::FURTHEST_MATE && static_eval - search_params.rfp_margin*depth >= beta){
+        search_stats.reverse_futility_prunes++;
+        return beta;//even if I lose some material, I am still above beta
+    }
+
+    //razoring
+    if(has_static_eval && depth <= Engine::RAZOR_MAX_DEPTH && static_eval + search_params.razor_margin*depth < alpha){
+        const Evaluation razor_score = Quiescence(Engine::QUIESCENCE_DEPTH, ply_data, alpha, alpha+1);
+        if(razor_score <= alpha){
+            search_stats.razor_prunes++;
+            return alpha;//so far behind that only captures could help, and they don't
+        }
+    }
+
     //NMP
     constexpr int nmp_reduction = 2;
     bool can_nmp = allow_null && //no previous null moves tried
+        mate_search_moves == 0 && //mate problems are full of zugzwang
         !ply_data->in_check && //illegal position if skipping my move whilst in check
         BitboardUtils::PopCount(current_board.colour_bitboard[current_board.turn] & ~current_board.piece_bitboard[PieceUtils::PAWN]) >= 3 && //3 non-pawn pieces needed, so no zugzwang
         depth >= nmp_reduction+1;//don't jump straight into qsearch, do it at high depths only
 
-    if(node_type != NodeType::ROOT && can_nmp){
+    if(node_type != NodeType::ROOT && can_nmp && !is_singular_search){
 
+        STATS_ONLY(detailed_stats.null_move_searches++;)
+        ply_data->current_move = MoveUtils::NULL_MOVE;
         BoardUtils::MakeNullMove(current_board, ply_data);
         curr_score = -NegaMax<NodeType::NORMAL>(depth-1-nmp_reduction, ply_data+1, -beta, 1-beta, previous_extensions, false);
         BoardUtils::UnMakeNullMove(current_board);
 
         if(curr_score >= beta){
+            STATS_ONLY(detailed_stats.null_move_cutoffs++;)
             return beta;//I skipped my move and still beat beta. must be great for me, so stop here
         }
     }
 
-    MoveSorting::CalculateMoveValues(move_scores, move_list, legal_move_count, tt_result.best_move, current_board, ply_data, history_heuristic[current_board.turn]);
+    const MoveSorting::QuietHistory quiet_history = GatherQuietHistory(ply_data);
+    MoveSorting::CalculateMoveValues(move_scores, move_list, legal_move_count, tt_move, current_board, ply_data, quiet_history);
+
+    //singular extensions: if every move except the TT move fails low, the TT move is the only good move, so search it deeper
+    bool tt_move_is_singular = false;
+    const TTEntry singular_entry = transposition_table.ProbeUnadjusted(ply_data->zobrist);
+    if(node_type != NodeType::ROOT && !is_singular_search && depth >= Engine::SINGULAR_MIN_DEPTH &&
+        singular_entry.best_move != MoveUtils::NULL_MOVE &&
+        (singular_entry.score_type & TTLookupType::LOWERBOUND) &&
+        singular_entry.subtree_depth >= depth - 3 &&
+        std::abs(singular_entry.score) < Eval::FURTHEST_MATE)
+    {
+        const Evaluation singular_beta = singular_entry.score - search_params.singular_margin*depth;
+
+        ply_data->excluded_move = singular_entry.best_move;
+        const Evaluation singular_score = NegaMax<NodeType::NORMAL>((depth-1)/2, ply_data, singular_beta-1, singular_beta, previous_extensions, false);
+        ply_data->excluded_move = MoveUtils::NULL_MOVE;
+        ply_data->best_move = MoveUtils::NULL_MOVE;//the exclusion search is not the result for this position
+
+        if(stop_condition.load(std::memory_order_relaxed)){
+            return 0;//out of time
+        }
+
+        if(singular_score < singular_beta){
+            tt_move_is_singular = true;
+            search_stats.singular_extensions++;
+        } else if(singular_beta >= beta){
+            search_stats.multi_cuts++;
+            return beta;//multi-cut: the TT move and at least one other move beat beta
+        }
+    }
+
+    const bool can_futility_prune = has_static_eval && depth <= Engine::FUTILITY_MAX_DEPTH && 
+        static_eval + search_params.futility_margin*depth <= alpha;//quiet moves won't be able to raise alpha
+    const int late_move_count = search_params.lmp_base + depth*depth;//how many moves to search before assuming the rest are bad
+
+    //only pushed now, as IID and the singular search re-search this same position, and would see it as a repetition of itself
+    SearchUtils::RepetitionScope repetition_scope(repetition_table, ply_data->zobrist);//this position is on the line while its children are searched
 
     for(int i=0;i<legal_move_count;i++){
         Move current_move = MoveSorting::SortNext(move_scores, move_list, legal_move_count, i);;
         assert(current_move != MoveUtils::NULL_MOVE);
 
+        if(current_move == ply_data->excluded_move){
+            continue;
+        }
+
+        const bool is_quiet = PieceUtils::IsEmpty(current_board.squares[MoveUtils::ToSquare(current_move)]) && PieceUtils::IsEmpty(MoveUtils::PromotionBase(current_move));
+        const int history_score = is_quiet ? MoveSorting::QuietHistoryScore(quiet_history, current_move, current_board) : 0;
+
+        //late move pruning
+        if(has_static_eval && is_quiet && depth <= Engine::LMP_MAX_DEPTH && i >= late_move_count){
+            search_stats.late_move_prunes++;
+            continue;
+        }
+
+        if(node_type == NodeType::ROOT && print_info && ElapsedMs() >= Engine::CURRMOVE_MIN_TIME_MS){
+            sync_cout << "info depth " << depth << " currmove " << StringTools::MoveToString(current_move) << " currmovenumber " << i+1 << std::endl;
+        }
+
+        ply_data->current_move = current_move;
+        ply_data->moved_piece = current_board.squares[MoveUtils::FromSquare(current_move)];
         BoardUtils::MakeMove(current_board, current_move, ply_data);
 
+        //futility pruning
+        if(can_futility_prune && is_quiet && i > 0 && !MoveGenerator::InCheck(current_board)){
+            BoardUtils::UnMakeMove(current_board, current_move, ply_data);
+            search_stats.futility_prunes++;
+            continue;
+        }
+
         //extensions
         int extension = 0;
         if (node_type != NodeType::ROOT && previous_extensions < 6){
             if(legal_move_count == 1//one reply extension
-                || ply_data->in_check)//check extension
+                || ply_data->in_check//check extension
+                || (tt_move_is_singular && current_move == singular_entry.best_move))//singular extension
             {
                 extension++;
             }
         }
+        const int new_depth = depth-1+extension;
 
-        const bool bad_idea_to_lmr = depth < 3;
-        if(i > 4 && !bad_idea_to_lmr){
-            constexpr int lmr_reduction=1;
-            curr_score = -NegaMax<NodeType::NORMAL>(depth-1-lmr_reduction+extension, ply_data+1, -alpha - 1, -alpha, previous_extensions+extension, true);//reduced depth
-            if(curr_score > alpha && curr_score < beta){
-                curr_score = -NegaMax<NodeType::NORMAL>(depth-1+extension, ply_data+1, -beta, -alpha, previous_extensions+extension, true);//normal full width search
+        int reduction = 0;
+        if(i >= 3 && depth >= 3 && is_quiet){
+            const bool gives_check = MoveGenerator::InCheck(current_board);
+            reduction = CalculateReduction(depth, i, is_pv, ply_data->in_check, gives_check, current_move == ply_data->killer_move, history_score);
+        }
+
+        STATS_ONLY(detailed_stats.moves_searched++;)
+        if(reduction > 0){
+            STATS_ONLY(detailed_stats.reduced_searches++;)
+            curr_score = -NegaMax<NodeType::NORMAL>(new_depth-reduction, ply_data+1, -alpha - 1, -alpha, previous_extensions+extension, true);//reduced depth
+            if(curr_score > alpha){
+                STATS_ONLY(detailed_stats.reduced_researches++;)
+                curr_score = -NegaMax<NodeType::NORMAL>(new_depth, ply_data+1, -beta, -alpha, previous_extensions+extension, true);//normal full width search
             }
         } else{
-            curr_score = -NegaMax<NodeType::NORMAL>(depth-1+extension, ply_data+1, -beta, -alpha, previous_extensions+extension, true);//normal full width search
+            curr_score = -NegaMax<NodeType::NORMAL>(new_depth, ply_data+1, -beta, -alpha, previous_extensions+extension, true);//normal full width search
         }
 
         BoardUtils::UnMakeMove(current_board, current_move, ply_data);
@@ -200,18 +442,24 @@ Evaluation Worker::NegaMax(int depth, SearchUtils::PlyData *ply_data, Evaluation
         }
         if(alpha >= beta){
             assert(alpha == curr_score);
-            transposition_table.Set(TranspositionUtils::GenerateEntry(ply_data->zobrist, ply_data->best_move, depth, TTLookupType::LOWERBOUND, beta));
+            STATS_ONLY(
+                detailed_stats.beta_cutoffs++;
+                detailed_stats.first_move_cutoffs += i == 0;
+            )
+            if(!is_singular_search){
+                transposition_table.Set(TranspositionUtils::GenerateEntry(ply_data->zobrist, ply_data->best_move, depth, TTLookupType::LOWERBOUND, beta), ply_data->ply_from_root);
+            }
             if(PieceUtils::IsEmpty(ply_data->killed)){//maybe block promotions and enpessant?
-                const int previous_history = history_heuristic[current_board.turn][MoveSorting::CalculateHistoryIndex(current_move)];
-                history_heuristic[current_board.turn][MoveSorting::CalculateHistoryIndex(current_move)] = MoveSorting::CalculateNewHistory(previous_history, depth);
-
+                UpdateQuietHistory(ply_data, current_move, depth);
                 ply_data->killer_move = current_move;
             }
             return beta;
         }
     }
 
-    transposition_table.Set(TranspositionUtils::GenerateEntry(ply_data->zobrist, ply_data->best_move, depth, score_type, alpha));
+    if(!is_singular_search){
+        transposition_table.Set(TranspositionUtils::GenerateEntry(ply_data->zobrist, ply_data->best_move, depth, score_type, alpha), ply_data->ply_from_root);
+    }
     return alpha;
 }
 
@@ -219,53 +467,181 @@ Evaluation Worker::Quiescence(int depth, SearchUtils::PlyData* ply_data, Evaluat
     assert(depth >= 0);
     assert(alpha < beta);
 
-    const Evaluation stand_pat = Eval::EvaluateBoard(current_board);//if just chilling here leads to a good eval, assume I can just do it
-    if(depth == 0){
+    STATS_ONLY(detailed_stats.qsearch_nodes++;)
+    selective_depth = std::max(selective_depth, ply_data->ply_from_root);
+
+    const TTEntry tt_result = transposition_table.ProbeAdjusted(ply_data->zobrist, TranspositionUtils::QSEARCH_DEPTH, ply_data->ply_from_root, alpha, beta);
+    STATS_ONLY(
+        detailed_stats.tt_probes++;
+        detailed_stats.tt_hits += tt_result.zobrist_hash == ply_data->zobrist;
+    )
+    if(tt_result.score != Eval::NULL_EVAL){
+        STATS_ONLY(detailed_stats.tt_cutoffs++;)
         leaf_nodes_searched++;
-        return stand_pat;
+        return tt_result.score;//this capture sequence has already been searched through another move order
     }
-    if(stand_pat >= beta){
+
+    if(ply_data->ply_from_root > 0 && ply_data->fifty_move_rule == 0){
+        const Bitbase::Result bitbase_result = Bitbase::Probe(current_board);
+        if(bitbase_result != Bitbase::NO_RESULT){
+            search_stats.bitbase_hits++;
+            leaf_nodes_searched++;
+            return std::clamp(Bitbase::ResultToScore(current_board, bitbase_result), alpha, beta);
+        }
+    }
+
+    const bool in_check = MoveGenerator::InCheck(current_board);//standing pat is illegal when in check
+
+    if(depth == 0){
         leaf_nodes_searched++;
-        return beta;//prune
+        return StaticEval();
     }
 
-    if(stand_pat > alpha){
-        alpha = stand_pat;
+    const Evaluation original_alpha = alpha;
+    Move best_move = MoveUtils::NULL_MOVE;
+    Evaluation stand_pat = Eval::NULL_EVAL;
+
+    if(!in_check){
+        stand_pat = StaticEval();//if just chilling here leads to a good eval, assume I can just do it
+        if(stand_pat >= beta){
+            leaf_nodes_searched++;
+            transposition_table.Set(TranspositionUtils::GenerateEntry(ply_data->zobrist, MoveUtils::NULL_MOVE, TranspositionUtils::QSEARCH_DEPTH, TTLookupType::LOWERBOUND, beta), ply_data->ply_from_root);
+            return beta;//prune
+        }
+
+        if(stand_pat > alpha){
+            alpha = stand_pat;
+        }
     }
+    //delta pruning: captures that can't win back enough material to reach alpha are not worth searching
+    const bool can_delta_prune = !in_check && alpha < Eval::FURTHEST_MATE;
 
-    Move move_list[MoveGenerator::MAX_CAPTURE_COUNT];
-    Move* end = current_board.turn ? MoveGenerator::GenerateMain<true, true>(current_board, ply_data, move_list) : MoveGenerator::GenerateMain<false, true>(current_board, ply_data, move_list);//maybe test by & moves to enemy squares?
+    //in check, this generates every evasion. the first ply of quiescence can also look at quiet checks
+    Move move_list[MoveGenerator::MAX_MOVE_COUNT];
+    Move* end;
+    if(search_params.qsearch_checks && depth == Engine::QUIESCENCE_DEPTH){
+        end = GenerateMoves<MoveGenerator::CAPTURES_AND_CHECKS>(ply_data, move_list);
+    } else {
+        end = GenerateMoves<MoveGenerator::CAPTURES>(ply_data, move_list);
+    }
     int legal_move_count = end - move_list;
+    assert(ply_data->in_check == in_check);
 
-    MoveSorting::QSort(move_list, legal_move_count, MoveUtils::NULL_MOVE, current_board);
+    if(in_check && legal_move_count == 0){
+        leaf_nodes_searched++;
+        return Eval::MakeMatedEvaluation(ply_data->ply_from_root);//checkmated
+    }
+
+    MoveSorting::QSort(move_list, legal_move_count, tt_result.best_move, current_board);
 
     for(int i=0;i<legal_move_count;i++){
         Move current_move = move_list[i];
+
+        const Piece victim = current_board.squares[MoveUtils::ToSquare(current_move)];
+        if(can_delta_prune && !PieceUtils::IsEmpty(victim) && PieceUtils::IsEmpty(MoveUtils::PromotionBase(current_move)) &&
+            stand_pat + Eval::PIECE_VALUES[PieceUtils::BasePiece(victim)] + search_params.delta_margin <= alpha){
+            search_stats.delta_prunes++;
+            continue;
+        }
+
         BoardUtils::MakeMove(current_board, current_move, ply_data);
         Evaluation curr_score = -Quiescence(depth-1, ply_data+1, -beta, -alpha);
         BoardUtils::UnMakeMove(current_board, current_move, ply_data);
 
         if(curr_score > alpha){
             alpha = curr_score;
+            best_move = current_move;
         }
         if(curr_score >= beta){
             leaf_nodes_searched++;
+            transposition_table.Set(TranspositionUtils::GenerateEntry(ply_data->zobrist, current_move, TranspositionUtils::QSEARCH_DEPTH, TTLookupType::LOWERBOUND, beta), ply_data->ply_from_root);
             return beta;
         }
     }
     leaf_nodes_searched++;
+    const TTLookupType score_type = alpha > original_alpha ? TTLookupType::EXACT : TTLookupType::UPPERBOUND;
+    transposition_table.Set(TranspositionUtils::GenerateEntry(ply_data->zobrist, best_move, TranspositionUtils::QSEARCH_DEPTH, score_type, alpha), ply_data->ply_from_root);
     return alpha;
 }
 
+/**
+ * @brief collects the history tables that apply to the moves from this position
+ */
+MoveSorting::QuietHistory Worker::GatherQuietHistory(const SearchUtils::PlyData *ply_data) const
+{
+    MoveSorting::QuietHistory result = {history_heuristic[current_board.turn], {nullptr, nullptr}, MoveUtils::NULL_MOVE};
+
+    for(int plies_back=1; plies_back<=2 && plies_back <= ply_data->ply_from_root; plies_back++){//don't read before the root, as the moves there are not filled in
+        const SearchUtils::PlyData* previous = ply_data - plies_back;
+        if(previous->current_move == MoveUtils::NULL_MOVE){
+            break;//null moves have no piece, and break the chain of moves
+        }
+        const int previous_index = MoveSorting::CalculatePieceToIndex(previous->moved_piece, previous->current_move);
+        result.continuations[plies_back-1] = &(*continuation_history[plies_back-1])[previous_index];
+        if(plies_back == 1){
+            result.countermove = countermoves[previous_index];
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief rewards a quiet move that caused a beta cutoff in every history table
+ * @param ply_data the position where best_move was played from
+ */
+void Worker::UpdateQuietHistory(const SearchUtils::PlyData *ply_data, Move best_move, int depth)
+{
+    int& butterfly = history_heuristic[current_board.turn][MoveSorting::CalculateHistoryIndex(best_move)];
+    butterfly = MoveSorting::CalculateNewHistory(butterfly, depth);
+
+    const int best_index = MoveSorting::CalculatePieceToIndex(ply_data->moved_piece, best_move);
+    for(int plies_back=1; plies_back<=2 && plies_back <= ply_data->ply_from_root; plies_back++){
+        const SearchUtils::PlyData* previous = ply_data - plies_back;
+        if(previous->current_move == MoveUtils::NULL_MOVE){
+            break;
+        }
+        const int previous_index = MoveSorting::CalculatePieceToIndex(previous->moved_piece, previous->current_move);
+        int& continuation = (*continuation_history[plies_back-1])[previous_index][best_index];
+        continuation = MoveSorting::CalculateNewHistory(continuation, depth);
+        if(plies_back == 1){
+            countermoves[previous_index] = best_move;
+        }
+    }
+}
+
+/**
+ * @brief looks up the late move reduction, then adjusts it for how interesting the move is
+ * @returns how many ply to reduce by, which always leaves at least one ply to search
+ */
+int Worker::CalculateReduction(int depth, int move_num, bool is_pv, bool in_check, bool gives_check, bool is_killer, int history_score) const
+{
+    int reduction = lmr_table[std::min(depth, Engine::LMR_TABLE_DEPTH-1)][std::min(move_num, MoveGenerator::MAX_MOVE_COUNT-1)];
+
+    //reduce less for moves and nodes that are likely to be important
+    reduction -= is_pv;
+    reduction -= in_check;
+    reduction -= gives_check;
+    reduction -= is_killer;
+    reduction -= std::clamp(history_score / search_params.lmr_history_divisor, 0, 2);//moves that often cause cutoffs get searched deeper
+
+    return std::clamp(reduction, 0, depth-2);
+}
+
 /**
  * @brief gets the pv moves, with a trailing space
  */
 std::string Worker::FindPV(SearchUtils::PlyData* ply_data_for_board){
     std::vector<Move> pv_moves = {};
+    std::vector<uint64_t> visited_zobrists = {};
     std::string text_output = {};
 
     for(int i=0;i<20;i++){
         SearchUtils::PlyData* current_ply_data = ply_data_for_board + i;
+        if(std::find(visited_zobrists.begin(), visited_zobrists.end(), current_ply_data->zobrist) != visited_zobrists.end()){
+            break;//the tt moves loop back to an earlier position, so the rest of the pv would just repeat
+        }
+        visited_zobrists.push_back(current_ply_data->zobrist);
         TTEntry entry = transposition_table.ProbeAdjusted(current_ply_data->zobrist, 0, current_ply_data->ply_from_root, Eval::START_NEGATIVE, -Eval::START_NEGATIVE);
         if(entry.score == Eval::NULL_EVAL || entry.best_move == MoveUtils::NULL_MOVE){
             break;//end of pv
@@ -284,21 +660,115 @@ std::string Worker::FindPV(SearchUtils::PlyData* ply_data_for_board){
     return text_output;
 }
 
+void Worker::SetSearchParams(const SearchParams &new_params)
+{
+    search_params = new_params;
+    lmr_table = Engine::CalculateReductionTable(search_params.lmr_base, search_params.lmr_divisor);
+}
+
+void Worker::PrintDetailedStats() const
+{
+#ifdef SEARCH_STATS
+    const DetailedSearchStats& stats = detailed_stats;
+    auto percent = [](uint64_t part, uint64_t whole){
+        return whole == 0 ? 0.0 : 100.0 * part / whole;
+    };
+    auto ratio = [](uint64_t numerator, uint64_t denominator){
+        return denominator == 0 ? 0.0 : (double)numerator / denominator;
+    };
+
+    sync_cout << std::fixed << std::setprecision(1) << "info string stats" <<
+    " interior " << stats.interior_nodes <<
+    " qnodes " << stats.qsearch_nodes <<
+    " tthit% " << percent(stats.tt_hits, stats.tt_probes) <<
+    " ttcut% " << percent(stats.tt_cutoffs, stats.tt_probes) <<
+    " firstcut% " << percent(stats.first_move_cutoffs, stats.beta_cutoffs) <<
+    " nullcut% " << percent(stats.null_move_cutoffs, stats.null_move_searches) <<
+    " lmrresearch% " << percent(stats.reduced_researches, stats.reduced_searches) <<
+    " branching " << ratio(stats.moves_searched, stats.interior_nodes) <<
+    " ebf " << ratio(stats.last_iteration_nodes, stats.previous_iteration_nodes) <<
+    " movegenms " << stats.movegen_ns / 1'000'000 <<
+    " evalms " << stats.eval_ns / 1'000'000 <<
+        std::defaultfloat << std::endl;
+#else
+    sync_cout << "info string stats are only collected when built with SEARCH_STATS" << std::endl;
+#endif
+}
+
+Evaluation Worker::FixedDepthScore(int depth)
+{
+    SearchUtils::PlyData* ply_data = current_ply_before_search;
+    ply_data->ply_from_root = 0;
+    end_time = TimePoint(UINT32_MAX);
+    search_start = TimePoint();
+    nodes_before_search = leaf_nodes_searched;
+    node_limit = 0;
+    mate_search_moves = 0;
+
+    if(depth > 0){
+        const Evaluation score = NegaMax<ROOT>(depth, ply_data, Eval::START_NEGATIVE, -Eval::START_NEGATIVE, 0, true);
+        if(score != Eval::NULL_EVAL){
+            return score;
+        }
+        //a forced move is not searched at the root, so score it with quiescence instead
+    }
+    return Quiescence(Engine::QUIESCENCE_DEPTH, ply_data, Eval::START_NEGATIVE, -Eval::START_NEGATIVE);
+}
+
+uint64_t Worker::ElapsedMs()
+{
+    return search_start.NowIsPastTimePoint() ? search_start.HowLongAgo() : 0;
+}
+
+uint64_t Worker::SearchNodes() const
+{
+    return leaf_nodes_searched - nodes_before_search;
+}
+
+void Worker::PrintHeartbeat()
+{
+    if(!print_info || !next_heartbeat.NowIsPastTimePoint()){
+        return;//printing every time would make the search spend its time flushing output
+    }
+    next_heartbeat = TimePoint(Engine::HEARTBEAT_INTERVAL_MS);
+
+    const uint64_t elapsed_ms = ElapsedMs();
+    const uint64_t nodes = SearchNodes();
+    sync_cout << "info nodes " << nodes <<
+    " nps " << nodes*1000 / std::max<uint64_t>(elapsed_ms, 1) <<
+    " hashfull " << transposition_table.CalculatePerMilFull() <<
+    " time " << elapsed_ms <<
+        std::endl;
+}
+
 void Worker::UpdateTimer()
 {
-    if(end_time.NowIsPastTimePoint()){
+    if(end_time.NowIsPastTimePoint() || (node_limit != 0 && SearchNodes() >= node_limit)){
         stop_condition.store(true);
     }
 }
 
-void Engine::StartSearch(Worker& w, int depth, uint64_t search_time_ms)
+void Engine::StartSearch(Worker& w, int depth, uint64_t search_time_ms, int mate_moves, uint64_t node_limit)
 {
     for(int i=0; i<2; i++){
         for(int j=0; j<64*64; j++){
             w.history_heuristic[i][j] = 0;//reset all the history
         }
+        for(MoveSorting::PieceToHistory& continuation : *w.continuation_history[i]){
+            continuation.fill(0);
+        }
     }
+    std::fill(std::begin(w.countermoves), std::end(w.countermoves), MoveUtils::NULL_MOVE);
+    w.search_stats = SearchStats();
+    w.detailed_stats = DetailedSearchStats();
+    w.mate_search_moves = mate_moves;
+    w.node_limit = node_limit;
     w.end_time = TimePoint(search_time_ms);
+    w.search_start = TimePoint();
+    w.next_heartbeat = TimePoint(Engine::HEARTBEAT_INTERVAL_MS);
+    w.nodes_before_search = w.leaf_nodes_searched;
+    w.selective_depth = 0;
+    w.transposition_table.NewSearch();
     w.RootSearch(depth, w.current_ply_before_search);
 }
 
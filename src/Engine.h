@@ -8,6 +8,174 @@
 #include "Eval.h"
 #include "TranspositionTable.h"
 #include "Timer.h"
+#include "MoveGenerator.h"
+#include "MoveSorting.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief search constants that can be changed at runtime through UCI options
+ * (must be all same type for tuning - this struct is cast to a int*)
+ */
+struct SearchParams {
+    //late move reductions, stored in hundredths: reduction = base + ln(depth)*ln(move number)/divisor
+    int lmr_base = 75;
+    int lmr_divisor = 225;
+    int lmr_history_divisor = 8000;//every this much history reduces the reduction by one ply
+
+    //pruning margins near the leaves, in centipawns per ply of depth
+    int rfp_margin = 80;
+    int futility_margin = 110;
+    int razor_margin = 250;
+    int lmp_base = 3;//late move pruning searches this many moves plus depth squared
+
+    int singular_margin = 3;//how far below the TT score, per ply of depth, the other moves must be for the TT move to be singular
+
+    int internal_iterative_mode = 1;//what to do when there is no TT move, see Engine::InternalIterativeMode
+
+    int qsearch_checks = 0;//when not 0, the first ply of quiescence search also tries quiet checking moves
+    int delta_margin = 200;//quiescence skips captures that can't raise the stand pat score to within this of alpha
+};
+
+/**
+ * @brief counters for how often each part of the search was used, reset every search
+ */
+struct SearchStats {
+    uint64_t reverse_futility_prunes = 0;
+    uint64_t razor_prunes = 0;
+    uint64_t futility_prunes = 0;
+    uint64_t late_move_prunes = 0;
+    uint64_t singular_extensions = 0;
+    uint64_t multi_cuts = 0;
+    uint64_t internal_iterative_reductions = 0;
+    uint64_t internal_iterative_searches = 0;
+    uint64_t delta_prunes = 0;
+    uint64_t bitbase_hits = 0;
+};
+
+/**
+ * @brief finer grained counters for tuning and spotting regressions, only collected in builds with SEARCH_STATS defined as they slow the search down
+ */
+struct DetailedSearchStats {
+    uint64_t interior_nodes = 0;
+    uint64_t qsearch_nodes = 0;
+
+    uint64_t tt_probes = 0;
+    uint64_t tt_hits = 0;//an entry for this position was found
+    uint64_t tt_cutoffs = 0;//the entry's score was good enough to return straight away
+
+    uint64_t beta_cutoffs = 0;
+    uint64_t first_move_cutoffs = 0;
+
+    uint64_t null_move_searches = 0;
+    uint64_t null_move_cutoffs = 0;
+
+    uint64_t reduced_searches = 0;
+    uint64_t reduced_researches = 0;//the reduced search beat alpha, so it had to be searched again at full depth
+
+    uint64_t moves_searched = 0;//in interior nodes, for the average branching factor
+
+    //nodes searched in the last two completed iterations, for the effective branching factor
+    uint64_t previous_iteration_nodes = 0;
+    uint64_t last_iteration_nodes = 0;
+
+    uint64_t movegen_ns = 0;
+    uint64_t eval_ns = 0;
+};
+
+//wraps code that collects DetailedSearchStats, so that it is compiled out unless SEARCH_STATS is defined
+#ifdef SEARCH_STATS
+#define STATS_ONLY(...) __VA_ARGS__
+#else
+#define STATS_ONLY(...)
+#endif
+
+/**
+ * @brief the outcome of the latest search, for tools that run searches without reading the UCI output
+ */
+struct SearchResult {
+    Move best_move = MoveUtils::NULL_MOVE;
+    Evaluation score = Eval::NULL_EVAL;//from the last completed iteration, for the side to move
+    int depth = 0;//of the last completed iteration
+    uint64_t nodes = 0;
+    std::string pv;//space separated moves, from the last completed iteration
+    uint64_t time_ms = 0;
+};
+
+namespace Engine
+{
+
+constexpr int LMR_TABLE_DEPTH = 64;
+
+//deepest remaining depth that each pruning technique is used at
+constexpr int RFP_MAX_DEPTH = 6;
+constexpr int RAZOR_MAX_DEPTH = 2;
+constexpr int FUTILITY_MAX_DEPTH = 3;
+constexpr int LMP_MAX_DEPTH = 3;
+
+//shallowest remaining depth that singular extensions are tried at
+constexpr int SINGULAR_MIN_DEPTH = 6;
+
+/**
+ * @brief ways of dealing with a position that has no TT move to search first
+ */
+enum InternalIterativeMode{
+    INTERNAL_ITERATIVE_OFF = 0,
+    INTERNAL_ITERATIVE_REDUCTION = 1,//search one ply shallower, as the position is probably not important
+    INTERNAL_ITERATIVE_DEEPENING = 2,//do a shallower search first to find a good move to search first
+};
+
+//shallowest remaining depth that internal iterative reductions/deepening are used at
+constexpr int INTERNAL_ITERATIVE_MIN_DEPTH = 4;
+constexpr int IID_REDUCTION = 2;
+
+/**
+ * @brief how many ply to reduce a late move by, indexed [depth][move number]
+ */
+using ReductionTable = std::array<std::array<uint8_t, MoveGenerator::MAX_MOVE_COUNT>, LMR_TABLE_DEPTH>;
+
+/**
+ * @brief natural log that can be run at compile time
+ */
+constexpr double ConstexprLn(double x){
+    double powers_of_two = 0;
+    while(x >= 2){
+        x /= 2;
+        powers_of_two++;
+    }
+    //ln(x) = 2*atanh((x-1)/(x+1)), which converges quickly now that x is in [1,2)
+    const double z = (x-1)/(x+1);
+    double term = z;
+    double result = 0;
+    for(int i=1;i<40;i+=2){
+        result += term/i;
+        term *= z*z;
+    }
+    return 2*result + powers_of_two*0.6931471805599453;
+}
+
+/**
+ * @brief generates the late move reduction table
+ * @param base_hundredths reduction applied to every late move, in hundredths of a ply
+ * @param divisor_hundredths how much to divide ln(depth)*ln(move number) by, in hundredths
+ */
+constexpr ReductionTable CalculateReductionTable(int base_hundredths, int divisor_hundredths){
+    ReductionTable result = {};
+    for(int depth=1;depth<LMR_TABLE_DEPTH;depth++){
+        for(int move_num=1;move_num<MoveGenerator::MAX_MOVE_COUNT;move_num++){
+            const double reduction = base_hundredths/100.0 + ConstexprLn(depth)*ConstexprLn(move_num)*100.0/divisor_hundredths;
+            result[depth][move_num] = reduction > 0 ? (uint8_t)reduction : 0;
+        }
+    }
+    return result;
+}
+
+constexpr ReductionTable DEFAULT_LMR_TABLE = CalculateReductionTable(SearchParams().lmr_base, SearchParams().lmr_divisor);
+
+} // namespace Engine
 
 class Worker {
     public:
@@ -20,40 +188,99 @@ class Worker {
     Board current_board;
     std::atomic<bool> &stop_condition;
     TimePoint end_time;
+    TimePoint search_start;
+    TimePoint next_heartbeat;//when the next info nodes/nps line may be printed
     TranspositionTable transposition_table;
     int history_heuristic[2][64*64];//[for each turn][from square + to square*64]
+    Move countermoves[MoveSorting::PIECE_TO_SIZE];//[previous move piece + to square*64] the move that refuted the previous move
+    std::unique_ptr<MoveSorting::ContinuationHistory> continuation_history[2];//[plies back - 1][previous move piece-to][current move piece-to]
 
     SearchUtils::PlyData current_board_search_stack[BoardUtils::MAX_GAME_LENGTH];
     SearchUtils::PlyData* current_ply_before_search;
+    SearchUtils::RepetitionTable repetition_table;//positions played before current_ply_before_search, and on the line being searched
+
+    SearchParams search_params;
+    Engine::ReductionTable lmr_table = Engine::DEFAULT_LMR_TABLE;
+    SearchStats search_stats;
+    DetailedSearchStats detailed_stats;
 
-    uint64_t leaf_nodes_searched = 0;
+    uint64_t leaf_nodes_searched = 0;//across every search, so that bench can total them
+    uint64_t nodes_before_search = 0;
+    int selective_depth = 0;//furthest ply from root reached this search, including quiescence
+
+    int mate_search_moves = 0;//when not 0, only looking for a mate in this many moves, so eval based pruning is turned off
+    uint64_t node_limit = 0;//when not 0, the search stops soon after searching this many nodes
+
+    bool print_info = true;//tools that run many searches at once turn this off, and read last_result instead
+    SearchResult last_result;
+    bool record_iterations = false;//when set, every completed iteration is kept in iteration_results, for tools that check when the best move settled
+    std::vector<SearchResult> iteration_results;
 
     Worker(std::atomic<bool> &stop_cond, int initial_hash_size): 
-    current_board(), stop_condition(stop_cond), transposition_table(initial_hash_size), history_heuristic(), current_board_search_stack(), current_ply_before_search(current_board_search_stack) {}
+    current_board(), stop_condition(stop_cond), transposition_table(initial_hash_size), history_heuristic(), countermoves(),
+    continuation_history{std::make_unique<MoveSorting::ContinuationHistory>(), std::make_unique<MoveSorting::ContinuationHistory>()},
+    current_board_search_stack(), current_ply_before_search(current_board_search_stack) {}
 
     void RootSearch(int max_depth, SearchUtils::PlyData* ply_data);
 
+    /**
+     * @brief sets new search parameters, and recalculates any tables that depend on them
+     */
+    void SetSearchParams(const SearchParams& new_params);
+
+    /**
+     * @brief prints the detailed stats of the latest search as an info string, or a note if they were compiled out
+     */
+    void PrintDetailedStats() const;
+
+    /**
+     * @brief searches the current position to a fixed depth with the full window, without iterative deepening or any output
+     * @param depth 0 for just a quiescence search
+     * @returns the score for the side to move
+     * @note for the tuner, which scores many positions with each set of search parameters. stop_condition must be false
+     */
+    Evaluation FixedDepthScore(int depth);
+
     private:
 
     template<NodeType node_type>
     Evaluation NegaMax(int depth, SearchUtils::PlyData *ply_data, Evaluation alpha, Evaluation beta, int previous_extensions, bool allow_null);
     Evaluation Quiescence(int depth, SearchUtils::PlyData* ply_data, Evaluation alpha, Evaluation beta);
+    template<MoveGenerator::GenType gen_type>
+    Move* GenerateMoves(SearchUtils::PlyData* ply_data, Move* move_list);
+    Evaluation StaticEval();
+    MoveSorting::QuietHistory GatherQuietHistory(const SearchUtils::PlyData* ply_data) const;
+    void UpdateQuietHistory(const SearchUtils::PlyData* ply_data, Move best_move, int depth);
+    int CalculateReduction(int depth, int move_num, bool is_pv, bool in_check, bool gives_check, bool is_killer, int history_score) const;
     std::string FindPV(SearchUtils::PlyData* ply_data_for_board);
     void UpdateTimer();
+    uint64_t ElapsedMs();
+    uint64_t SearchNodes() const;
+
+    /**
+     * @brief prints the node count and speed, at most once every HEARTBEAT_INTERVAL_MS
+     */
+    void PrintHeartbeat();
 };
 
 namespace Engine
 {
 
 constexpr int MAX_SEARCH_DEPTH = 30;
+
+//output rate limits, so that long searches still show progress without flooding the GUI
+constexpr uint64_t HEARTBEAT_INTERVAL_MS = 1000;
+constexpr uint64_t CURRMOVE_MIN_TIME_MS = 3000;//only show the root move being searched once the search has gone on this long
 constexpr int QUIESCENCE_DEPTH = 6;
 
 /**
  * @brief the main search function
  * @param worker the worker to call
  * @param depth the approximate depth to search to
+ * @param mate_moves when not 0, the search stops once a mate in this many moves is found
+ * @param node_limit when not 0, the search stops once it has searched about this many nodes
  */
-void StartSearch(Worker& w, int depth, uint64_t time_limit_ms);
+void StartSearch(Worker& w, int depth, uint64_t time_limit_ms, int mate_moves = 0, uint64_t node_limit = 0);
 
 bool BoardIsOK(Board& board, const SearchUtils::PlyData* ply_data);
 } // namespace Engine
@@ -26,6 +26,9 @@ namespace Eval
     constexpr Evaluation FURTHEST_MATE = CHECKMATE_WIN-100;
     constexpr Evaluation START_NEGATIVE = -CHECKMATE_WIN - 1;//below the worst, so I always find a move
 
+    //rough material values indexed by base piece, for pruning decisions that can't wait for the network
+    constexpr Evaluation PIECE_VALUES[6] = {320, 330, 500, 900, 100, 0};
+
     /**
      * @brief calculates the static evaluation of the board
      */
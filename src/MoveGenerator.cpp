@@ -137,26 +137,63 @@ Move* GeneratePawnMoves(Bitboard pawns, Bitboard blockers, Bitboard valid_end_lo
 }
 
 /**
- * @brief simpler pawn move generation for only pawn captures, excluding enpessant
+ * @brief shifts every bit in the bitboard by offset squares, where positive is towards h8
  */
-template<bool turn>//no enpessant to speed things up maybe?
-Move* GeneratePawnCaptures(Bitboard pawns, Bitboard capturable_pieces, Bitboard hv_pinmask, Bitboard diag_pinmask, Move* move_list){
-    //TODO don't loop pawns for captures, just do set captures, and subtract the jump made, but this can't work with pins etc.
-
-    pawns &= ~hv_pinmask;//no captures possible when pinned either horisontally or vertically
-
-    Bitloop(pawns){
-        Square current_sq = BitboardUtils::FindLSB(pawns);
-        Bitboard current_pawn = BitboardUtils::MakeBitBoard(current_sq);
-
-        Bitboard captures = BitboardUtils::GeneratePawnSetAttacks<turn>(current_pawn) & capturable_pieces;
+template<int offset>
+inline Bitboard ShiftBB(Bitboard b){
+    if constexpr(offset > 0){
+        return b << offset;
+    } else{
+        return b >> -offset;
+    }
+}
 
-        if(current_pawn&diag_pinmask){
-            captures &= diag_pinmask;//can only capture along my ray
-        }
+/**
+ * @brief adds a move to each set bit of destinations, coming from the square offset squares behind it
+ */
+template<int offset>
+inline Move* AddFromShiftedBB(Bitboard destinations, Piece promotion, Move* movelist_next){
+    Bitloop(destinations){
+        const Square to = BitboardUtils::FindLSB(destinations);
+        *movelist_next++ = MoveUtils::MakeMove(to - offset, to, promotion);
+    }
+    return movelist_next;
+}
 
-        move_list = AddFromBB(captures & BitboardUtils::NOT_PROMOTION, current_sq, move_list);
-        move_list = AddPromotions(captures & BitboardUtils::PROMOTION, current_sq, move_list);
+/**
+ * @brief set-wise pawn move generation for captures and queen promotions, excluding enpessant
+ * @note queen promotions are added first, and underpromotions are only generated for captures
+ * @warning pins are handled, but the check mask is not, so only use this when not in check
+ */
+template<bool turn>
+Move* GeneratePawnCaptures(Bitboard pawns, Bitboard capturable_pieces, Bitboard empty_squares, Bitboard hv_pinmask, Bitboard diag_pinmask, Move* move_list){
+    constexpr int left_offset = turn ? 7 : -9;//capturing towards the a file
+    constexpr int right_offset = turn ? 9 : -7;//capturing towards the h file
+    constexpr int push_offset = turn ? 8 : -8;
+    constexpr Bitboard promoting_rank = turn ? BitboardUtils::RANK_7 : BitboardUtils::RANK_2;
+
+    const Bitboard free_pawns = pawns & ~hv_pinmask & ~diag_pinmask;
+    const Bitboard diag_pinned_pawns = pawns & diag_pinmask;//can only capture along their pin, and can't be pinned along any other diagonal
+    const Bitboard hv_pinned_pawns = pawns & hv_pinmask;//can only push along their pin, and never capture
+
+    const Bitboard left_captures = (ShiftBB<left_offset>(free_pawns & ~BitboardUtils::FILE_A) | 
+        (ShiftBB<left_offset>(diag_pinned_pawns & ~BitboardUtils::FILE_A) & diag_pinmask)) & capturable_pieces;
+    const Bitboard right_captures = (ShiftBB<right_offset>(free_pawns & ~BitboardUtils::FILE_H) | 
+        (ShiftBB<right_offset>(diag_pinned_pawns & ~BitboardUtils::FILE_H) & diag_pinmask)) & capturable_pieces;
+    const Bitboard promotion_pushes = (ShiftBB<push_offset>(free_pawns & promoting_rank) | 
+        (ShiftBB<push_offset>(hv_pinned_pawns & promoting_rank) & hv_pinmask)) & empty_squares;
+
+    //queen promotions are nearly always best, so go first
+    move_list = AddFromShiftedBB<left_offset>(left_captures & BitboardUtils::PROMOTION, PieceUtils::QUEEN, move_list);
+    move_list = AddFromShiftedBB<right_offset>(right_captures & BitboardUtils::PROMOTION, PieceUtils::QUEEN, move_list);
+    move_list = AddFromShiftedBB<push_offset>(promotion_pushes, PieceUtils::QUEEN, move_list);
+
+    move_list = AddFromShiftedBB<left_offset>(left_captures & BitboardUtils::NOT_PROMOTION, PieceUtils::EMPTY, move_list);
+    move_list = AddFromShiftedBB<right_offset>(right_captures & BitboardUtils::NOT_PROMOTION, PieceUtils::EMPTY, move_list);
+
+    for(Piece promo : {PieceUtils::KNIGHT, PieceUtils::ROOK, PieceUtils::BISHOP}){
+        move_list = AddFromShiftedBB<left_offset>(left_captures & BitboardUtils::PROMOTION, promo, move_list);
+        move_list = AddFromShiftedBB<right_offset>(right_captures & BitboardUtils::PROMOTION, promo, move_list);
     }
 
     return move_list;
@@ -212,7 +249,7 @@ Bitboard CalculatePinsAndUpdateCheckMask(Bitboard enemy_samedirection_sliders, S
     return result;
 }
 
-template<bool turn, bool captures_only>
+template<bool turn, MoveGenerator::GenType gen_type>
 Move* MoveGenerator::GenerateMain(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list){
     const Bitboard my_pieces = board.colour_bitboard[turn];
     const Bitboard enemy_pieces = board.colour_bitboard[!turn];
@@ -235,15 +272,19 @@ Move* MoveGenerator::GenerateMain(const Board &board, SearchUtils::PlyData* ply_
         knights & enemy_pieces,
         BitboardUtils::FindLSB(board.piece_bitboard[PieceUtils::KING] & enemy_pieces));
 
-    ply_data->in_check = board.piece_bitboard[PieceUtils::KING] & my_pieces & enemy_attack_squares;//if enemy attack is my king square
+    const bool in_check = board.piece_bitboard[PieceUtils::KING] & my_pieces & enemy_attack_squares;//if enemy attack is my king square
+    ply_data->in_check = in_check;
+
+    const bool generate_quiets = gen_type == ALL_MOVES || in_check;//every evasion is needed when in check
+    const Bitboard quiet_filter = generate_quiets ? BitboardUtils::ALL_SQUARES : enemy_pieces;
 
-    const Bitboard king_move_bb = MoveLookup::KingLookup(my_king) & ~my_pieces & ~enemy_attack_squares & (captures_only ? enemy_pieces : BitboardUtils::ALL_SQUARES);//conditionally screen for captures
+    const Bitboard king_move_bb = MoveLookup::KingLookup(my_king) & ~my_pieces & ~enemy_attack_squares & quiet_filter;//conditionally screen for captures
     move_list = AddFromBB(king_move_bb, my_king, move_list);
 
     //this is the checkmask also
-    Bitboard nonking_end_squares = ~my_pieces & (captures_only ? enemy_pieces : BitboardUtils::ALL_SQUARES);//I can go anywhere except on to my own pieces, and sometimes only captures too
+    Bitboard nonking_end_squares = ~my_pieces & quiet_filter;//I can go anywhere except on to my own pieces, and sometimes only captures too
 
-    if constexpr(!captures_only){
+    if constexpr(gen_type == ALL_MOVES){
         constexpr Bitboard my_kingside_checkmask = turn ? CastlingUtils::WK_CHECK_MASK : CastlingUtils::BK_CHECK_MASK;
         constexpr Bitboard my_kingside_piecemask = turn ? CastlingUtils::WK_PIECE_MASK : CastlingUtils::BK_PIECE_MASK;
         constexpr Castling my_kingside_castle_type    = turn ? CastlingUtils::WK_CASTLE : CastlingUtils::BK_CASTLE;
@@ -290,7 +331,7 @@ Move* MoveGenerator::GenerateMain(const Board &board, SearchUtils::PlyData* ply_
 
     move_list = GenerateKnightMoves(knights&my_pieces, nonking_end_squares, hv_pinmask|diag_pinmask, move_list);
 
-    if constexpr(!captures_only){
+    if(generate_quiets){
         //maybe remove branching entirely
         //this branch +20Mnps on branch inside GeneratePawnMoves
         if(SquareUtils::IsValid(ply_data->enpessant)){
@@ -300,13 +341,65 @@ Move* MoveGenerator::GenerateMain(const Board &board, SearchUtils::PlyData* ply_
             move_list = GeneratePawnMoves<turn, false>(pawns & my_pieces,
             all_blockers, nonking_end_squares, enemy_pieces,ply_data->enpessant, hv_pinmask, diag_pinmask,my_king, orthogonal_sliders&enemy_pieces, move_list);
         }
-    } else {
-        move_list = GeneratePawnCaptures<turn>(pawns & my_pieces, nonking_end_squares, hv_pinmask, diag_pinmask, move_list);
+        return move_list;//all the checking moves have been generated already
+    }
+
+    move_list = GeneratePawnCaptures<turn>(pawns & my_pieces, nonking_end_squares, ~all_blockers, hv_pinmask, diag_pinmask, move_list);
+
+    if constexpr(gen_type == CAPTURES_AND_CHECKS){
+        //squares that directly attack the enemy king from each type of piece (attacks from the king back to them)
+        const Square enemy_king = BitboardUtils::FindLSB(board.piece_bitboard[PieceUtils::KING] & enemy_pieces);
+        const Bitboard empty_squares = ~all_blockers;
+        const Bitboard rook_checks = MoveLookup::SliderLookup<PieceUtils::ROOK>(enemy_king, all_blockers) & empty_squares;
+        const Bitboard bishop_checks = MoveLookup::SliderLookup<PieceUtils::BISHOP>(enemy_king, all_blockers) & empty_squares;
+        const Bitboard knight_checks = MoveLookup::KnightLookup(enemy_king) & empty_squares;
+        const Bitboard pawn_checks = BitboardUtils::GeneratePawnSetAttacks<!turn>(BitboardUtils::MakeBitBoard(enemy_king)) & empty_squares & BitboardUtils::NOT_PROMOTION;
+
+        const Bitboard queens = board.piece_bitboard[PieceUtils::QUEEN] & my_pieces;
+
+        move_list = GenerateSliderMoves<PieceUtils::ROOK>(board.piece_bitboard[PieceUtils::ROOK] & my_pieces,
+            all_blockers, rook_checks, hv_pinmask, diag_pinmask, move_list);
+        move_list = GenerateSliderMoves<PieceUtils::BISHOP>(board.piece_bitboard[PieceUtils::BISHOP] & my_pieces,
+            all_blockers, bishop_checks, hv_pinmask, diag_pinmask, move_list);
+        //a queen checks from either type of line, and a square can't be on both its orthogonal and diagonal moves, so there are no duplicates
+        move_list = GenerateSliderMoves<PieceUtils::ROOK>(queens,
+            all_blockers, rook_checks | bishop_checks, hv_pinmask, diag_pinmask, move_list);
+        move_list = GenerateSliderMoves<PieceUtils::BISHOP>(queens,
+            all_blockers, rook_checks | bishop_checks, hv_pinmask, diag_pinmask, move_list);
+
+        move_list = GenerateKnightMoves(knights&my_pieces, knight_checks, hv_pinmask|diag_pinmask, move_list);
+
+        //no capturable pieces, so only pushes are generated
+        move_list = GeneratePawnMoves<turn, false>(pawns & my_pieces,
+            all_blockers, pawn_checks, 0, SquareUtils::NULL_SQUARE, hv_pinmask, diag_pinmask, my_king, orthogonal_sliders&enemy_pieces, move_list);
     }
 
     return move_list;
 }
 
+bool MoveGenerator::InCheck(const Board &board)
+{
+    const Bitboard my_pieces = board.colour_bitboard[board.turn];
+    const Bitboard enemy_pieces = board.colour_bitboard[!board.turn];
+    const Bitboard all_blockers = my_pieces | enemy_pieces;
+    const Square my_king = BitboardUtils::FindLSB(board.piece_bitboard[PieceUtils::KING] & my_pieces);
+    const Bitboard king_bb = BitboardUtils::MakeBitBoard(my_king);
+
+    const Bitboard orthogonal_sliders = board.piece_bitboard[PieceUtils::ROOK] | board.piece_bitboard[PieceUtils::QUEEN];
+    const Bitboard diagonal_sliders = board.piece_bitboard[PieceUtils::BISHOP] | board.piece_bitboard[PieceUtils::QUEEN];
+
+    //pawn attacks from king to pawns = pawn attacks from enemy in opposite direction to king
+    const Bitboard pawn_checkers = board.turn ? BitboardUtils::GeneratePawnSetAttacks<true>(king_bb) : BitboardUtils::GeneratePawnSetAttacks<false>(king_bb);
+
+    const Bitboard attackers = 
+        (MoveLookup::KnightLookup(my_king) & board.piece_bitboard[PieceUtils::KNIGHT]) |
+        (pawn_checkers & board.piece_bitboard[PieceUtils::PAWN]) |
+        (MoveLookup::SliderLookup<PieceUtils::ROOK>(my_king, all_blockers) & orthogonal_sliders) |
+        (MoveLookup::SliderLookup<PieceUtils::BISHOP>(my_king, all_blockers) & diagonal_sliders);
+
+    return attackers & enemy_pieces;
+}
+
 bool MoveGenerator::VerifyMove(const Board &board, Move candidate)
 {
     if(candidate == MoveUtils::NULL_MOVE) return true;
@@ -328,8 +421,11 @@ bool MoveGenerator::VerifyMove(const Board &board, Move candidate)
     return true;//i am not entirely sure, but this move looks ok
 }
 
-template Move* MoveGenerator::GenerateMain<true, false>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
-template Move* MoveGenerator::GenerateMain<false, false>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
+template Move* MoveGenerator::GenerateMain<true, MoveGenerator::ALL_MOVES>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
+template Move* MoveGenerator::GenerateMain<false, MoveGenerator::ALL_MOVES>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
+
+template Move* MoveGenerator::GenerateMain<true, MoveGenerator::CAPTURES>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
+template Move* MoveGenerator::GenerateMain<false, MoveGenerator::CAPTURES>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
 
-template Move* MoveGenerator::GenerateMain<true, true>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
-template Move* MoveGenerator::GenerateMain<false, true>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
\ No newline at end of file
+template Move* MoveGenerator::GenerateMain<true, MoveGenerator::CAPTURES_AND_CHECKS>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
+template Move* MoveGenerator::GenerateMain<false, MoveGenerator::CAPTURES_AND_CHECKS>(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
\ No newline at end of file
@@ -7,15 +7,31 @@ namespace MoveGenerator{
 constexpr int MAX_MOVE_COUNT = 256;
 constexpr int MAX_CAPTURE_COUNT = 74;
 
+/**
+ * @brief which legal moves to generate
+ * @note when in check, every mode generates all the legal evasions, as standing pat or only capturing is not allowed
+ */
+enum GenType{
+    ALL_MOVES,
+    CAPTURES,//captures and queen promotions
+    CAPTURES_AND_CHECKS,//CAPTURES, and quiet moves that directly attack the enemy king (no discovered checks)
+};
+
 /**
  * @brief generates all legal moves
  * @param board the board whose legal moves are to be listed
  * @param move_list the start of an array of moves to which all legal moves will be written to (should be 256 elements long)
  * @returns a pointer to the last move added plus one
  */
-template<bool turn, bool captures_only>
+template<bool turn, GenType gen_type>
 Move* GenerateMain(const Board &board, SearchUtils::PlyData* ply_data, Move* move_list);
 
+/**
+ * @brief detects whether the side to move is in check, without generating any moves
+ * @note useful after making a move, to see if that move gives check
+ */
+bool InCheck(const Board &board);
+
 /**
  * @brief performs some basic checks to ensure that a move is likely to be legal
  * @warning NULL_MOVE counts as legal
@@ -36,12 +36,26 @@ int MoveSorting::CalculateNewHistory(int old_history, int depth)
     return old_history + bonus - (old_history * bonus) / MAX_HISTORY;//try this on desmos. It really clamps it between min and max history!
 }
 
-void MoveSorting::CalculateMoveValues(int *score_list, const Move move_list[MoveGenerator::MAX_MOVE_COUNT], int moves_count, Move expected_best_move, const Board &board, const SearchUtils::PlyData *ply_data, const int this_side_history[64*64])
+int MoveSorting::QuietHistoryScore(const QuietHistory &history, Move m, const Board &board)
+{
+    int score = history.butterfly[CalculateHistoryIndex(m)];
+
+    const int piece_to_index = CalculatePieceToIndex(board.squares[MoveUtils::FromSquare(m)], m);
+    for(const PieceToHistory* continuation : history.continuations){
+        if(continuation != nullptr){
+            score += (*continuation)[piece_to_index];
+        }
+    }
+    return score;
+}
+
+void MoveSorting::CalculateMoveValues(int *score_list, const Move move_list[MoveGenerator::MAX_MOVE_COUNT], int moves_count, Move expected_best_move, const Board &board, const SearchUtils::PlyData *ply_data, const QuietHistory& history)
 {
     assert(moves_count <= MoveGenerator::MAX_MOVE_COUNT);
     constexpr int PV_BONUS =      900'000'000;
     constexpr int CAPTURE_BONUS = 800'000'000;
     constexpr int KILLER_BONUS =  700'000'000;
+    constexpr int COUNTER_BONUS = 600'000'000;
 
     //score moves
     for(int i=0;i<moves_count;i++){
@@ -62,13 +76,18 @@ void MoveSorting::CalculateMoveValues(int *score_list, const Move move_list[Move
             continue;
         }
 
-        score_list[i] = this_side_history[CalculateHistoryIndex(current)];
+        if(current == history.countermove){
+            score_list[i] = COUNTER_BONUS;
+            continue;
+        }
+
+        score_list[i] = QuietHistoryScore(history, current, board);
     }
 }
 
 Move MoveSorting::SortNext(int *score_list, Move *move_list, int moves_count, int next_to_sort)
 {
-    assert(moves_count <= MoveGenerator::MAX_CAPTURE_COUNT);
+    assert(moves_count <= MoveGenerator::MAX_MOVE_COUNT);
     int index_of_biggest = next_to_sort;
     int score_of_biggest = score_list[index_of_biggest];
     for (int j = next_to_sort + 1; j < moves_count; j++) {
@@ -86,11 +105,14 @@ Move MoveSorting::SortNext(int *score_list, Move *move_list, int moves_count, in
     return move_list[next_to_sort];//return the now-sorted item
 }
 
-void MoveSorting::QSort(Move move_list[MoveGenerator::MAX_CAPTURE_COUNT], int moves_count, Move expected_best_move, const Board &board)
+void MoveSorting::QSort(Move move_list[MoveGenerator::MAX_MOVE_COUNT], int moves_count, Move expected_best_move, const Board &board)
 {
-    assert(moves_count <= MoveGenerator::MAX_CAPTURE_COUNT);
+    assert(moves_count <= MoveGenerator::MAX_MOVE_COUNT);
     constexpr int PV_BONUS = 900'000'000;
-    int move_scores[MoveGenerator::MAX_CAPTURE_COUNT];
+    constexpr int QUIET_SCORE = 0;//checks and evasions go after all the captures
+    constexpr int QUEEN_PROMOTION_BONUS = 50;//gaining a queen is worth about as much as capturing one
+    constexpr int UNDERPROMOTION_SCORE = -1;//almost never useful, so try them last
+    int move_scores[MoveGenerator::MAX_MOVE_COUNT];
 
     //score moves
     for(int i=0;i<moves_count;i++){
@@ -99,8 +121,17 @@ void MoveSorting::QSort(Move move_list[MoveGenerator::MAX_CAPTURE_COUNT], int mo
             move_scores[i] = PV_BONUS;//PV is very good
             continue;
         }
-        //Piece captured = board.squares[MoveUtils::ToSquare(move_list[i])];
-        move_scores[i] = CalculateMoveValue(current, board);
+        const Piece promotion = MoveUtils::PromotionBase(current);
+        if(!PieceUtils::IsEmpty(promotion) && promotion != PieceUtils::QUEEN){
+            move_scores[i] = UNDERPROMOTION_SCORE;
+            continue;
+        }
+        const int promotion_score = promotion == PieceUtils::QUEEN ? QUEEN_PROMOTION_BONUS : 0;
+        if(PieceUtils::IsEmpty(board.squares[MoveUtils::ToSquare(current)])){
+            move_scores[i] = QUIET_SCORE + promotion_score;
+            continue;
+        }
+        move_scores[i] = CalculateMoveValue(current, board) + promotion_score;
     }
 
     //sort move_list by move_scores
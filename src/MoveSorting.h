@@ -2,8 +2,31 @@
 #include "Board.h"
 #include "MoveGenerator.h"
 
+#include <array>
+
 namespace MoveSorting{
 
+    constexpr int PIECE_TO_SIZE = (PieceUtils::MAX_NUM+1) * 64;
+
+    /**
+     * @brief history for every move, indexed by [CalculatePieceToIndex()]
+     */
+    using PieceToHistory = std::array<int, PIECE_TO_SIZE>;
+
+    /**
+     * @brief history for pairs of moves, indexed [earlier move][later move] by CalculatePieceToIndex()
+     */
+    using ContinuationHistory = std::array<PieceToHistory, PIECE_TO_SIZE>;
+
+    /**
+     * @brief all the tables used to guess how good a quiet move is
+     */
+    struct QuietHistory {
+        const int* butterfly;//[from square + to square*64] for the side to move
+        const PieceToHistory* continuations[2];//histories following the moves 1 and 2 ply ago, or nullptr if there is no such move
+        Move countermove;//the move that last refuted the previous move
+    };
+
     /**
      * @brief calculates a clamped new value for history heuristic tables
      * @param old_history what the previous history value was
@@ -18,14 +41,27 @@ namespace MoveSorting{
      */
     inline int CalculateHistoryIndex(Move m){return MoveUtils::FromSquare(m) + 64*MoveUtils::ToSquare(m);}
 
+    /**
+     * @brief calculates the index for countermove and continuation history tables
+     * @param moved_piece the coloured piece that made the move
+     * @returns moved_piece*64 + tosquare
+     */
+    inline int CalculatePieceToIndex(Piece moved_piece, Move m){return moved_piece*64 + MoveUtils::ToSquare(m);}
+
+    /**
+     * @brief sums the butterfly and continuation histories for a quiet move
+     */
+    int QuietHistoryScore(const QuietHistory& history, Move m, const Board& board);
+
     /**
      * @brief scores but does not sort the moves on how promising they look
      * @param score_list the output of scores for each move
      * @param move_list a list of all moves playable on board
      * @param moves_count the number of used moves in move_list i.e number of legal moves
      * @param expected_best_move which move you expect to be a PV from here, often collected from transposition table etc.
+     * @param history the tables used to order quiet moves
      */
-    void CalculateMoveValues(int *score_list, const Move move_list[MoveGenerator::MAX_MOVE_COUNT], int moves_count, Move expected_best_move, const Board &board, const SearchUtils::PlyData* ply_data, const int this_side_history[64*64]);
+    void CalculateMoveValues(int *score_list, const Move move_list[MoveGenerator::MAX_MOVE_COUNT], int moves_count, Move expected_best_move, const Board &board, const SearchUtils::PlyData* ply_data, const QuietHistory& history);
 
     /**
      * @brief sorts the next element in the move_list by score_list, using selection sort
@@ -38,9 +74,9 @@ namespace MoveSorting{
     Move SortNext(int *score_list, Move *move_list, int moves_count, int num_already_sorted);
 
     /**
-     * @brief sorts the captures from most promising to least
+     * @brief sorts the captures and queen promotions from most promising to least, with any quiet checks or evasions, then underpromotions last
      * @param move_list a list of all moves playable on board
      * @param moves_count the number of used moves in move_list i.e number of legal moves
      */
-    void QSort(Move move_list[MoveGenerator::MAX_CAPTURE_COUNT], int moves_count, Move expected_best_move, const Board &board);
+    void QSort(Move move_list[MoveGenerator::MAX_MOVE_COUNT], int moves_count, Move expected_best_move, const Board &board);
 }
\ No newline at end of file
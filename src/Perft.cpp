@@ -20,7 +20,7 @@ unsigned long long Perft(Board &board, SearchUtils::PlyData* ply_data, const std
     }
 
     Move move_list[MoveGenerator::MAX_MOVE_COUNT];
-    Move* end = board.turn ? MoveGenerator::GenerateMain<true, false>(board,ply_data, move_list) : MoveGenerator::GenerateMain<false, false>(board,ply_data, move_list);
+    Move* end = board.turn ? MoveGenerator::GenerateMain<true, MoveGenerator::ALL_MOVES>(board,ply_data, move_list) : MoveGenerator::GenerateMain<false, MoveGenerator::ALL_MOVES>(board,ply_data, move_list);
     int legal_move_count = end - move_list;
 
     if constexpr(depth==1){
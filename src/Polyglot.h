@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Board.h"
+#include <string>
+#include <random>
+
+namespace Polyglot
+{
+//layout of the random key table, in the same order as the polyglot book format
+constexpr int PIECE_KEYS = 12 * 64;//[(2 * polyglot piece type + is white) * 64 + square]
+constexpr int CASTLING_KEYS_START = PIECE_KEYS;//white short, white long, black short, black long
+constexpr int ENPESSANT_KEYS_START = CASTLING_KEYS_START + 4;//[file]
+constexpr int TURN_KEY = ENPESSANT_KEYS_START + 8;//only used when white is to move
+constexpr int TOTAL_KEYS = TURN_KEY + 1;
+
+/**
+ * @brief calculates the polyglot book key of the position, which is separate from the board's own zobrist hash
+ * @note the enpessant file is only included if a pawn could actually capture enpessant, as polyglot requires
+ */
+uint64_t CalculateKey(const Board& board, const SearchUtils::PlyData* ply_data);
+
+/**
+ * @brief a read only polyglot .bin opening book, memory mapped so that only the pages that are searched get loaded
+ */
+class Book{
+public:
+    Book();
+    ~Book();
+
+    Book(const Book&) = delete;
+    Book& operator=(const Book&) = delete;
+
+    /**
+     * @brief closes any open book, then opens the book at path
+     * @returns true if the book was opened
+     */
+    bool Open(const std::string& path);
+
+    void Close();
+
+    bool IsOpen() const {return data != nullptr;}
+
+    /**
+     * @brief picks a book move for the position, randomly weighted by each move's weight in the book
+     * @returns a legal move, or NULL_MOVE if the position is not in the book
+     * @warning ply_data+1 must be a valid ply data, as it is used by move generation
+     */
+    Move Probe(const Board& board, SearchUtils::PlyData* ply_data);
+
+private:
+    static constexpr size_t ENTRY_SIZE = 16;//key, move, weight, learn. all big endian
+
+    /**
+     * @brief finds the index of the first entry with a key not less than key
+     */
+    size_t LowerBound(uint64_t key) const;
+
+    uint64_t ReadKey(size_t index) const;
+    uint16_t ReadMove(size_t index) const;
+    uint16_t ReadWeight(size_t index) const;
+
+    const unsigned char* data;
+    size_t mapped_size;
+    size_t entry_count;
+    std::mt19937_64 rng;
+};
+
+} // namespace Polyglot
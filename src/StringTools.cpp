@@ -1,6 +1,7 @@
 #include "StringTools.h"
 
 #include <string>
+#include <charconv>
 
 #include "Util.h"
 #include "Castling.h"
@@ -11,18 +12,22 @@
 #include <format>
 #include "Eval.h"
 
-void StringTools::ReadFEN(std::string fen, Board& board, SearchUtils::PlyData* ply_data)
+void StringTools::ReadFEN(std::string_view fen, Board& board, SearchUtils::PlyData* ply_data)
 {
-    std::istringstream iss(fen);
-
-    std::string piece_placement;
-    std::string active_colour;
-    std::string castling_rights;
-    std::string enpessant_square;
-    std::string fifty_move_rule;
-    std::string full_moves;
-
-    iss >> piece_placement >> active_colour >> castling_rights >> enpessant_square >> fifty_move_rule >> full_moves;
+    //split into fields without copying, as training data generation reads a FEN for every pv it replays
+    std::string_view fields[6];
+    for(std::string_view& field : fields){
+        const size_t start = std::min(fen.find_first_not_of(' '), fen.size());
+        fen.remove_prefix(start);
+        const size_t end = std::min(fen.find(' '), fen.size());
+        field = fen.substr(0, end);
+        fen.remove_prefix(end);
+    }
+    const std::string_view& piece_placement = fields[0];
+    const std::string_view& active_colour = fields[1];
+    const std::string_view& castling_rights = fields[2];
+    const std::string_view& enpessant_square = fields[3];
+    const std::string_view& fifty_move_rule = fields[4];
 
     // Reset the squares to empty
     for(Square i=0;i<64;i++){
@@ -97,10 +102,10 @@ void StringTools::ReadFEN(std::string fen, Board& board, SearchUtils::PlyData* p
 
     board.turn = active_colour == "w";
 
-    ply_data->enpessant = FromString(enpessant_square);
+    ply_data->enpessant = FromString(std::string(enpessant_square));//at most 2 letters, so no allocation
 
     if(!fifty_move_rule.empty()){
-        ply_data->fifty_move_rule = std::stoi(fifty_move_rule);
+        std::from_chars(fifty_move_rule.data(), fifty_move_rule.data() + fifty_move_rule.size(), ply_data->fifty_move_rule);
     }
 
     ply_data->zobrist = BoardUtils::CalculateZobristHash(board, ply_data);
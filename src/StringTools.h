@@ -3,6 +3,7 @@
 #include "Util.h"
 
 #include <string>
+#include <string_view>
 #include "Board.h"
 #include "Eval.h"
 
@@ -18,7 +19,7 @@ bool IsMove(const std::string& text);
 /// @brief parses a FEN string to a board position
 /// @param fen the FEN string to parse
 /// @param board the board to be overwritten
-void ReadFEN(std::string fen, Board& board, SearchUtils::PlyData* ply_data);
+void ReadFEN(std::string_view fen, Board& board, SearchUtils::PlyData* ply_data);
 
 Square FromString(std::string sq);
 
@@ -12,6 +12,8 @@ struct SearchLimits{
     SearchType search_type=SearchType::DEFAULT;
     int search_depth=100;
     int search_time_ms=INT_MAX;
+    int mate_moves=0;//when not 0, stop as soon as a mate in this many moves is found
+    uint64_t node_limit=0;//when not 0, stop after searching about this many nodes
 };
 
 class TimePoint{
@@ -1,5 +1,7 @@
 #include "TranspositionTable.h"
 
+static_assert(sizeof(TTEntry) == 24, "the generation should fit in the padding after the score type");
+
 inline uint64_t CalculateEntryIndex(uint64_t zobrist_hash, uint64_t num_entries){return zobrist_hash % num_entries;}
 
 TTEntry TranspositionUtils::GenerateEntry(uint64_t zobrist, Move best, int ply_to_leaves, TTLookupType score_type, Evaluation score)
@@ -9,6 +11,7 @@ TTEntry TranspositionUtils::GenerateEntry(uint64_t zobrist, Move best, int ply_t
 		best,
 		ply_to_leaves,
 		score_type,
+		0,//set by TranspositionTable::Set
 		score
 	};
 }
@@ -24,9 +27,31 @@ void TranspositionTable::Resize(int MB_size)
 	ClearTable();
 }
 
-void TranspositionTable::Set(TTEntry entry)
+void TranspositionTable::Set(TTEntry entry, int ply_from_root)
+{
+	//mate scores are relative to the root, but the entry can be reached at any ply, so store it as mate from this position
+	if(entry.score >= Eval::FURTHEST_MATE){
+		entry.score += ply_from_root;
+	} else if(entry.score <= -Eval::FURTHEST_MATE){
+		entry.score -= ply_from_root;
+	}
+
+	TTEntry& slot = entries[CalculateEntryIndex(entry.zobrist_hash, number_of_entries)];
+
+	const bool new_is_qsearch = entry.subtree_depth <= TranspositionUtils::QSEARCH_DEPTH;
+	const bool slot_is_main_search = slot.score != Eval::NULL_EVAL && slot.subtree_depth > TranspositionUtils::QSEARCH_DEPTH;
+	const bool slot_is_useful = slot.zobrist_hash == entry.zobrist_hash || slot.generation == generation;//an entry for another position from an old search is unlikely to be probed again
+	if(new_is_qsearch && slot_is_main_search && slot_is_useful){
+		return;//keep the deeper entry
+	}
+
+	entry.generation = generation;
+	slot = entry;
+}
+
+void TranspositionTable::NewSearch()
 {
-	entries[CalculateEntryIndex(entry.zobrist_hash, number_of_entries)] = entry;
+	generation++;
 }
 
 inline Evaluation AdjustEval(Evaluation eval, TTLookupType eval_type, int ply_from_root, Evaluation alpha, Evaluation beta)
@@ -7,7 +7,7 @@
 /**
  * @brief this enum stores what type of score a position has
  */
-enum TTLookupType{
+enum TTLookupType : uint8_t{
     UPPERBOUND = 1,//Alpha result
     LOWERBOUND = 2,//Beta result
     EXACT = UPPERBOUND | LOWERBOUND,//Exact result is both an upper and lower bound
@@ -27,6 +27,8 @@ struct TTEntry {
     
     //what type of score has been stored
     TTLookupType score_type;
+    //which search stored this entry, so that entries left over from earlier searches can be replaced
+    uint8_t generation = 0;
     //the score calculated when this entry was inserted
     Evaluation score = Eval::NULL_EVAL;
 };
@@ -50,8 +52,15 @@ class TranspositionTable {
      * @brief stores the entry in the transposition table.
      * The table uses a MOD based indexing method to overwrite and store entries
      * @param entry the entry that is to be put in
+     * @param ply_from_root how deep in the search the entry's position is, so mate scores can be stored relative to it
+     * @note quiescence entries don't replace a main search entry for the same position, or from the current search, as those are far more expensive to recalculate
      */
-    void Set(TTEntry entry);
+    void Set(TTEntry entry, int ply_from_root);
+
+    /**
+     * @brief starts a new generation, so that entries from earlier searches can be replaced by anything
+     */
+    void NewSearch();
 
     /**
      * @brief gets the evaluation, if applicable, of the zobrist score
@@ -78,12 +87,19 @@ class TranspositionTable {
     
     private:
 
-    uint64_t number_of_entries;
-    TTEntry *entries;
+    uint64_t number_of_entries = 0;
+    TTEntry *entries = nullptr;//Resize deletes the old entries, so this must start as nullptr
+    uint8_t generation = 0;//wraps around, which only means that a very old entry is briefly treated as current
 };
 
 namespace TranspositionUtils
 {
+    /**
+     * @brief the subtree depth that quiescence search results are stored with
+     * @note the main search always asks for at least 1 ply, so it never gets a cutoff from these entries
+     */
+    constexpr int QSEARCH_DEPTH = 0;
+
     /**
      * @brief generates a transposition table entry based on data from the current search
      * @param zobrist the zobrist hash of the current position
@@ -7,15 +7,18 @@
 #include "Timer.h"
 #include "Engine.h"
 #include "Perft.h"
+#include "Bench.h"
+#include "Bitbase.h"
 
 #include <unordered_map>
 #include <vector>
 #include <optional>
 #include "StringTools.h"
 #include <cassert>
+#include <algorithm>
 
 void UCI::Init(){
-
+    Bitbase::InitInBackground();//generating takes about a second, which would hold up the uci handshake
 }
 
 void ParseGoCommand(const std::string &operand, UCI::Context& ctx){
@@ -24,7 +27,8 @@ void ParseGoCommand(const std::string &operand, UCI::Context& ctx){
 
     std::vector<std::string> searchmoves;
     int myside_time=INT_MAX, myside_increment=0, movetime=INT_MAX;
-    int depth=INT_MAX, _nodes_limit=INT_MAX;
+    int depth=INT_MAX, mate_moves=0;
+    uint64_t nodes_limit=0;
 
     std::istringstream stream(operand);
     std::string token;
@@ -49,13 +53,16 @@ void ParseGoCommand(const std::string &operand, UCI::Context& ctx){
         else if (token == "btime" && !turn) stream >> myside_time;
         else if (token == "winc" && turn) stream >> myside_increment;
         else if (token == "binc" && !turn) stream >> myside_increment;
-        else if (token == "depth" || token == "mate") stream >> depth;
-        else if (token == "nodes") stream >> _nodes_limit;
+        else if (token == "depth") stream >> depth;
+        else if (token == "mate") stream >> mate_moves;
+        else if (token == "nodes") stream >> nodes_limit;
         else if (token == "movetime") stream >> movetime;
     }
     ctx.operation = {};
 
     ctx.operation.search_depth = depth;
+    ctx.operation.mate_moves = mate_moves;
+    ctx.operation.node_limit = nodes_limit;
 
     if(perft){
         ctx.operation.search_type = PERFT;
@@ -68,6 +75,22 @@ void ParseGoCommand(const std::string &operand, UCI::Context& ctx){
     );
 }
 
+/**
+ * @brief creates the line describing a spin option, to be sent after "uci"
+ */
+std::string SpinOptionToString(const UCI::UCISpinOption<int>& option){
+    return "option name " + option.name + " type spin default " + std::to_string(option.default_value) + " min " + std::to_string(option.min_value) + " max " + std::to_string(option.max_value) + "\n";
+}
+
+std::string CheckOptionToString(const UCI::UCICheckOption& option){
+    return "option name " + option.name + " type check default " + (option.default_value ? "true" : "false") + "\n";
+}
+
+std::string StringOptionToString(const UCI::UCIStringOption& option){
+    //an empty default is sent as <empty>, as UCI has no way to send an empty string
+    return "option name " + option.name + " type string default " + (option.default_value.empty() ? "<empty>" : option.default_value) + "\n";
+}
+
 UCI::Command ParseCommand(const std::string& command){
     std::unordered_map<std::string, UCI::Command> command_mappings = {
         {"uci", UCI::UCI},
@@ -81,6 +104,8 @@ UCI::Command ParseCommand(const std::string& command){
         {"stop", UCI::STOP},
         {"ponderhit", UCI::PONDERHIT},
         {"static", UCI::STATIC_EVAL},
+        {"bench", UCI::BENCH},
+        {"stats", UCI::STATS},
     };
     if(!command_mappings.contains(command)){
         return UCI::NO_COMMAND;
@@ -98,11 +123,13 @@ void ParsePositionCommand(const std::string& operand, UCI::Context& ctx){
         position_fen = pre_moves.substr(4);
     }
     ctx.worker.current_ply_before_search = ctx.worker.current_board_search_stack;//reset pointer to start
+    ctx.worker.repetition_table.Clear();
 
     StringTools::ReadFEN(position_fen, ctx.worker.current_board, ctx.worker.current_ply_before_search);
 
     for(std::string move : StringHandling::SplitBySpace(moves_str)){
         Move to_play = StringTools::MoveFromString(ctx.worker.current_ply_before_search, move);
+        ctx.worker.repetition_table.Push(ctx.worker.current_ply_before_search->zobrist);//the position before the move is now part of the game
         //play the UCI move
         BoardUtils::MakeMove(ctx.worker.current_board, to_play, ctx.worker.current_ply_before_search);
         //ctx.current_data->current_move = to_play;//save the played move like it has been searched
@@ -134,9 +161,18 @@ void UCI::HandleMessage(const std::string& message, Context& ctx)
     switch (ParseCommand(command))
     {
     case UCI:
-        sync_cout << "id name Mandelbrot\n" << "id author Stu\n"
-        << "option name " << ctx.hash_size_mb.name << " type spin default " << ctx.hash_size_mb.default_value << " min " << ctx.hash_size_mb.min_value << " max " << ctx.hash_size_mb.max_value << "\n"
-         << "uciok" << std::endl;
+        {
+            std::string options = SpinOptionToString(ctx.hash_size_mb);
+            for(const SearchParamOption& search_option : ctx.search_param_options){
+                options += SpinOptionToString(search_option.option);
+            }
+            options += CheckOptionToString(ctx.own_book);
+            options += StringOptionToString(ctx.book_file);
+            options += CheckOptionToString(ctx.kbnk_bitbase);
+            sync_cout << "id name Mandelbrot\n" << "id author Stu\n"
+            << options
+            << "uciok" << std::endl;
+        }
         return;
 
     case DEBUG:
@@ -162,6 +198,42 @@ void UCI::HandleMessage(const std::string& message, Context& ctx)
                 ctx.hash_size_mb.current_value = std::stoi(new_value);
                 ctx.worker.transposition_table.Resize(ctx.hash_size_mb.current_value);
             }
+
+            if(name == ctx.own_book.name){
+                ctx.own_book.current_value = new_value == "true";
+            }
+
+            if(name == ctx.book_file.name){
+                ctx.book_file.current_value = new_value == "<empty>" ? "" : new_value;
+                ctx.opening_book.Close();
+                if(!ctx.book_file.current_value.empty()){
+                    if(!ctx.opening_book.Open(ctx.book_file.current_value)){
+                        sync_cout << "info string could not open book " << ctx.book_file.current_value << std::endl;
+                    }
+                }
+            }
+
+            if(name == ctx.kbnk_bitbase.name){
+                ctx.kbnk_bitbase.current_value = new_value == "true";
+                Bitbase::SetKBNKEnabled(ctx.kbnk_bitbase.current_value);
+            }
+
+            for(SearchParamOption& search_option : ctx.search_param_options){
+                if(name == search_option.option.name){
+                    int parsed_value;
+                    try{
+                        parsed_value = std::stoi(new_value);
+                    } catch(const std::exception&){
+                        sync_cout << "info string invalid value for " << name << ": " << new_value << std::endl;
+                        break;//keep the current value
+                    }
+                    search_option.option.current_value = std::clamp(parsed_value, search_option.option.min_value, search_option.option.max_value);
+
+                    SearchParams new_params = ctx.worker.search_params;
+                    new_params.*search_option.param = search_option.option.current_value;
+                    ctx.worker.SetSearchParams(new_params);
+                }
+            }
         }
         return;
     
@@ -185,7 +257,15 @@ void UCI::HandleMessage(const std::string& message, Context& ctx)
         switch (ctx.operation.search_type)
         {
         case DEFAULT:
-            ctx.searcher_thread.emplace(std::thread(Engine::StartSearch, std::ref(ctx.worker), ctx.operation.search_depth, ctx.operation.search_time_ms));
+            {
+                const Move book_move = ctx.own_book.current_value && ctx.operation.mate_moves == 0 ? 
+                    ctx.opening_book.Probe(ctx.worker.current_board, ctx.worker.current_ply_before_search) : MoveUtils::NULL_MOVE;
+                if(book_move != MoveUtils::NULL_MOVE){
+                    sync_cout << "bestmove " << StringTools::MoveToString(book_move) << std::endl;//no need to search a known opening
+                    break;
+                }
+            }
+            ctx.searcher_thread.emplace(std::thread(Engine::StartSearch, std::ref(ctx.worker), ctx.operation.search_depth, ctx.operation.search_time_ms, ctx.operation.mate_moves, ctx.operation.node_limit));
             break;
         case PERFT:
             ctx.searcher_thread.emplace(std::thread(PerftEngine::StartPerft, std::ref(ctx.worker.current_board), ctx.operation.search_depth, std::ref(ctx.worker.current_ply_before_search), std::ref(ctx.stop_flag)));
@@ -206,6 +286,31 @@ void UCI::HandleMessage(const std::string& message, Context& ctx)
         sync_cout << Eval::EvaluateBoard(ctx.worker.current_board) << std::endl;
         return;
 
+    case BENCH:
+        {
+            Stop(ctx);
+            int depth = Bench::DEFAULT_BENCH_DEPTH;
+            if(!operand.empty()){
+                try{
+                    depth = std::stoi(operand);
+                } catch(const std::exception&){
+                    depth = 0;
+                }
+                if(depth < 1 || depth > Engine::MAX_SEARCH_DEPTH){
+                    sync_cout << "info string invalid bench depth " << operand << ", using " << Bench::DEFAULT_BENCH_DEPTH << std::endl;
+                    depth = Bench::DEFAULT_BENCH_DEPTH;
+                }
+            }
+            Bench::RunBench(ctx.worker, depth);
+            ctx.stop_flag.store(false);
+        }
+        return;
+
+    case STATS:
+        Stop(ctx);//the counters are only safe to read once the search thread has finished
+        ctx.worker.PrintDetailedStats();
+        return;
+
     case NO_COMMAND:
         sync_dbg << "invalid command:" << command << ", skipping it." << std::endl;
         return;
@@ -215,6 +320,7 @@ void UCI::HandleMessage(const std::string& message, Context& ctx)
         
     case QUIT:
         Stop(ctx);
+        Bitbase::CancelInit();
         return;
     }
 }
\ No newline at end of file
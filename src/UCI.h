@@ -4,8 +4,10 @@
 #include "Board.h"
 #include "Timer.h"
 #include <optional>
+#include <vector>
 #include "TranspositionTable.h"
 #include "Engine.h"
+#include "Polyglot.h"
 
 namespace UCI{
 
@@ -23,6 +25,8 @@ enum Command{
     STOP,
     PONDERHIT,
     STATIC_EVAL,
+    BENCH,
+    STATS,
 };
 
 template<typename T>
@@ -36,11 +40,55 @@ struct UCISpinOption{
     T current_value;
 };
 
+struct UCICheckOption{
+    UCICheckOption(std::string name, bool default_val): name(name), default_value(default_val), current_value(default_val) {}
+
+    const std::string name;
+    const bool default_value;
+    bool current_value;
+};
+
+struct UCIStringOption{
+    UCIStringOption(std::string name, std::string default_val): name(name), default_value(default_val), current_value(default_val) {}
+
+    const std::string name;
+    const std::string default_value;
+    std::string current_value;
+};
+
+/**
+ * @brief a spin option that edits a value in the worker's SearchParams
+ */
+struct SearchParamOption{
+    UCISpinOption<int> option;
+    int SearchParams::* param;
+};
+
 struct Context{
     Context() = default;
 
     UCISpinOption<int> hash_size_mb = UCISpinOption<int>("Hash", INT_MAX, 1, 64);
 
+    std::vector<SearchParamOption> search_param_options = {
+        {UCISpinOption<int>("LMRBase", 300, 0, SearchParams().lmr_base), &SearchParams::lmr_base},
+        {UCISpinOption<int>("LMRDivisor", 1000, 50, SearchParams().lmr_divisor), &SearchParams::lmr_divisor},
+        {UCISpinOption<int>("LMRHistoryDivisor", 1'000'000, 1, SearchParams().lmr_history_divisor), &SearchParams::lmr_history_divisor},
+        {UCISpinOption<int>("RFPMargin", 1000, 0, SearchParams().rfp_margin), &SearchParams::rfp_margin},
+        {UCISpinOption<int>("FutilityMargin", 1000, 0, SearchParams().futility_margin), &SearchParams::futility_margin},
+        {UCISpinOption<int>("RazorMargin", 2000, 0, SearchParams().razor_margin), &SearchParams::razor_margin},
+        {UCISpinOption<int>("LMPBase", 100, 0, SearchParams().lmp_base), &SearchParams::lmp_base},
+        {UCISpinOption<int>("SingularMargin", 100, 0, SearchParams().singular_margin), &SearchParams::singular_margin},
+        {UCISpinOption<int>("InternalIterativeMode", Engine::INTERNAL_ITERATIVE_DEEPENING, Engine::INTERNAL_ITERATIVE_OFF, SearchParams().internal_iterative_mode), &SearchParams::internal_iterative_mode},
+        {UCISpinOption<int>("QSearchChecks", 1, 0, SearchParams().qsearch_checks), &SearchParams::qsearch_checks},
+        {UCISpinOption<int>("DeltaMargin", 2000, 0, SearchParams().delta_margin), &SearchParams::delta_margin},
+    };
+
+    UCICheckOption own_book = UCICheckOption("OwnBook", false);
+    UCIStringOption book_file = UCIStringOption("BookFile", "");
+    Polyglot::Book opening_book;
+
+    UCICheckOption kbnk_bitbase = UCICheckOption("KBNKBitbase", false);//takes over a minute to generate, so it is off by default
+
     std::optional<std::thread> searcher_thread = std::nullopt;
     SearchLimits operation;
     std::atomic<bool> stop_flag = {true};
@@ -1,4 +1,5 @@
 #include "Util.h"
+#include <cassert>
 
 //SquareUtils
 
@@ -62,20 +63,45 @@ Bitboard BitboardUtils::SquaresInFront(Square square)
     }
 }
 
-bool SearchUtils::IsDraw(PlyData* current_node){
-    PlyData* previous = current_node-2;
+void SearchUtils::RepetitionTable::Clear()
+{
+    while(line_length > 0){
+        Pop();
+    }
+}
 
-    if(current_node->fifty_move_rule >= 100){
-        return true;//repetition by fifty move rule
+void SearchUtils::RepetitionTable::Push(uint64_t zobrist)
+{
+    assert(line_length < TABLE_SIZE/2);//keep the table sparse so probes stay short
+
+    uint32_t slot = zobrist & (TABLE_SIZE-1);
+    while(table[slot].line_index != EMPTY_SLOT){
+        slot = (slot+1) & (TABLE_SIZE-1);
     }
 
-    uint64_t current_hash = current_node->zobrist;
+    table[slot] = {zobrist, line_length+1};
+    pushed_slots[line_length] = slot;
+    line_length++;
+}
+
+void SearchUtils::RepetitionTable::Pop()
+{
+    assert(line_length > 0);
+    line_length--;
+    table[pushed_slots[line_length]].line_index = EMPTY_SLOT;
+}
+
+bool SearchUtils::RepetitionTable::IsRepetition(uint64_t zobrist, unsigned int fifty_move_rule) const
+{
+    if(fifty_move_rule < 4){
+        return false;//a position can't repeat without at least 2 reversible moves by each side
+    }
 
-    for(unsigned int i=2;i<current_node->fifty_move_rule;i+=2){//might not work, as FENs with big fifty move counters could cause searches of positions before the FEN, which obviously don't exist
-        if(current_hash == previous->zobrist){
+    for(uint32_t slot = zobrist & (TABLE_SIZE-1); table[slot].line_index != EMPTY_SLOT; slot = (slot+1) & (TABLE_SIZE-1)){
+        const uint32_t plies_ago = line_length - (table[slot].line_index-1);
+        if(table[slot].zobrist == zobrist && plies_ago <= fifty_move_rule){
             return true;
         }
-        previous -= 2;//back 2 nodes
     }
 
     return false;
@@ -171,6 +171,9 @@ constexpr Bitboard FILE_H = FILE_A << 7;
 constexpr Bitboard DOUBLE_PUSH =       0x00ff00000000ff00ULL;
 constexpr Bitboard AFTER_DOUBLE_PUSH = 0x000000ffff000000ULL;
 
+constexpr Bitboard RANK_2 =            0x000000000000ff00ULL;
+constexpr Bitboard RANK_7 =            0x00ff000000000000ULL;
+
 constexpr Bitboard PROMOTION =         0xff000000000000ffULL;
 constexpr Bitboard NOT_PROMOTION = ~PROMOTION;
 
@@ -298,8 +301,72 @@ struct ALIGN_CACHE PlyData{
     Move best_move;
 
     Move killer_move = MoveUtils::NULL_MOVE;
+
+    //the move being searched from this position, and which piece made it (for continuation history)
+    Move current_move = MoveUtils::NULL_MOVE;
+    Piece moved_piece = PieceUtils::EMPTY;
+
+    //a move to skip when searching this position, used by singular extensions
+    Move excluded_move = MoveUtils::NULL_MOVE;
+};
+
+/**
+ * @brief every position on the current line, from the start of the game to the node being searched, for repetition detection
+ * open addressing with linear probing. positions are always added and removed last in first out,
+ * so the most recent one can be removed by clearing its slot without breaking any other probe sequence
+ */
+class RepetitionTable{
+public:
+    RepetitionTable() = default;
+
+    /**
+     * @brief forgets every position, for when a new game or position is started
+     */
+    void Clear();
+
+    /**
+     * @brief adds a position to the end of the current line
+     */
+    void Push(uint64_t zobrist);
+
+    /**
+     * @brief removes the most recently pushed position
+     */
+    void Pop();
+
+    /**
+     * @brief checks whether the position has already happened since the last irreversible move
+     * @param fifty_move_rule the position's halfmove clock, so positions before the last capture or pawn move are ignored
+     * @returns true if the position is a repetition
+     */
+    bool IsRepetition(uint64_t zobrist, unsigned int fifty_move_rule) const;
+
+private:
+    static constexpr uint32_t TABLE_SIZE = 16384;//must be a power of 2, and comfortably bigger than a game plus a search
+    static constexpr uint32_t EMPTY_SLOT = 0;
+
+    struct Entry{
+        uint64_t zobrist;
+        uint32_t line_index;//1 + how many positions came before this one on the line, or EMPTY_SLOT
+    };
+
+    Entry table[TABLE_SIZE] = {};
+    uint16_t pushed_slots[TABLE_SIZE];//which slot each position on the line was put in, so that it can be popped
+    uint32_t line_length = 0;
 };
 
-bool IsDraw(PlyData* current_node);
+/**
+ * @brief pushes a position to the repetition table, and pops it when going out of scope
+ */
+class RepetitionScope{
+public:
+    RepetitionScope(RepetitionTable& table, uint64_t zobrist) : table(table) {table.Push(zobrist);}
+    ~RepetitionScope() {table.Pop();}
+
+    RepetitionScope(const RepetitionScope&) = delete;
+    RepetitionScope& operator=(const RepetitionScope&) = delete;
+private:
+    RepetitionTable& table;
+};
 
 } // namespace SearchUtils
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "Board.h"
+#include "Engine.h"
+#include "StringTools.h"
+#include "threadsafe_io.h"
+#include "command_line.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief analyses every position in an EPD or FEN file, searching several positions at once on independent workers
+ * @note each output line is the input position as EPD with the analysis added as opcodes, in the same order as the input.
+ * the transposition table is cleared before each position, so with the same hash per thread the results do not depend on the thread count
+ */
+namespace BatchAnalysis {
+
+constexpr int DEFAULT_DEPTH = 10;
+constexpr size_t REORDER_WINDOW = 4096;//how far ahead of the oldest unfinished position the threads can get
+
+/**
+ * @brief settings from the command line
+ */
+struct Config{
+    std::string input_path;
+    std::string output_path;//when empty, results are written to stdout
+    unsigned thread_count = std::thread::hardware_concurrency();
+    int hash_mb = 64;//shared out between the threads
+    int depth = 0;
+    uint64_t nodes = 0;
+    uint64_t movetime_ms = 0;
+};
+
+const std::string USAGE = "usage: main --input <epd or fen file> [--output <file>] [--threads <count>] [--hash <MB in total>] "
+    "[--depth <ply> | --nodes <count> | --movetime <ms>]";
+
+const std::vector<CommandLine::Flag<Config>> FLAGS = {
+    {"--input",    [](Config& config, const std::string& value){ config.input_path = value; }},
+    {"--output",   [](Config& config, const std::string& value){ config.output_path = value; }},
+    {"--threads",  [](Config& config, const std::string& value){ config.thread_count = std::max(std::stoi(value), 1); }},
+    {"--hash",     [](Config& config, const std::string& value){ config.hash_mb = std::max(std::stoi(value), 1); }},
+    {"--depth",    [](Config& config, const std::string& value){ config.depth = std::clamp(std::stoi(value), 1, Engine::MAX_SEARCH_DEPTH); }},
+    {"--nodes",    [](Config& config, const std::string& value){ config.nodes = std::max<uint64_t>(std::stoull(value), 1); }},
+    {"--movetime", [](Config& config, const std::string& value){ config.movetime_ms = std::max<uint64_t>(std::stoull(value), 1); }},
+};
+
+/**
+ * @returns the settings, or nullopt (after printing why) if the arguments are wrong
+ */
+inline std::optional<Config> ParseArguments(int argc, char** argv){
+    Config config;
+    if(!CommandLine::ParseFlags(argc, argv, FLAGS, USAGE, config)){
+        return std::nullopt;
+    }
+
+    if(config.input_path.empty()){
+        sync_cout << USAGE << std::endl;
+        return std::nullopt;
+    }
+    if((config.depth != 0) + (config.nodes != 0) + (config.movetime_ms != 0) > 1){
+        sync_cout << "only one of --depth, --nodes and --movetime can be used" << std::endl;
+        return std::nullopt;
+    }
+    if(config.depth == 0 && config.nodes == 0 && config.movetime_ms == 0){
+        config.depth = DEFAULT_DEPTH;
+    }
+    config.thread_count = std::max(config.thread_count, 1u);
+    return config;
+}
+
+/**
+ * @brief one line of the input, split into a FEN to search and the EPD to print the results after
+ */
+struct InputPosition{
+    std::string fen;
+    std::string epd;//the four position fields and any opcodes from the input, or the halfmove and fullmove counters as opcodes for a FEN
+};
+
+/**
+ * @returns the position on a line of EPD or FEN, or nullopt if the line doesn't start with one
+ */
+inline std::optional<InputPosition> ParseLine(const std::string& line){
+    std::istringstream fields(line);
+    std::string placement, turn, castling, enpassant;
+    if(!(fields >> placement >> turn >> castling >> enpassant) || (turn != "w" && turn != "b")){
+        return std::nullopt;
+    }
+    const std::string position = placement + " " + turn + " " + castling + " " + enpassant;
+
+    std::string rest;
+    std::getline(fields, rest);
+    rest.erase(0, rest.find_first_not_of(' '));
+    rest.erase(rest.find_last_not_of(" \r") + 1);
+
+    //a FEN has the halfmove and fullmove counters next, where an EPD goes straight to its opcodes
+    std::istringstream counters(rest);
+    unsigned halfmove, fullmove;
+    if(counters >> halfmove >> fullmove){
+        std::string opcodes;
+        std::getline(counters, opcodes);
+        return InputPosition{
+            position + " " + std::to_string(halfmove) + " " + std::to_string(fullmove),
+            position + opcodes + " hmvc " + std::to_string(halfmove) + "; fmvn " + std::to_string(fullmove) + ";"
+        };
+    }
+    return InputPosition{position + " 0 1", rest.empty() ? position : position + " " + rest};
+}
+
+/**
+ * @returns the analysis as EPD opcodes: ce (or dm for a mate), acd, acn, bm and pv
+ */
+inline std::string AnalysisOpcodes(const SearchResult& result){
+    std::ostringstream out;
+    if(result.score == Eval::NULL_EVAL){
+        //a forced move has no score
+    } else if(std::abs(result.score) >= Eval::FURTHEST_MATE){
+        const int mate_moves = (Eval::CHECKMATE_WIN - std::abs(result.score) + 1) / 2;//mate ply to moves, like StringTools::ScoreToString
+        out << " dm " << (result.score > 0 ? mate_moves : -mate_moves) << ";";
+    } else {
+        out << " ce " << result.score << ";";
+    }
+    out << " acd " << result.depth << "; acn " << result.nodes << ";";
+    if(result.best_move != MoveUtils::NULL_MOVE){
+        std::string pv = result.pv.empty() ? StringTools::MoveToString(result.best_move) : result.pv;
+        pv.erase(pv.find_last_not_of(' ') + 1);
+        out << " bm " << StringTools::MoveToString(result.best_move) << "; pv " << pv << ";";
+    }
+    return out.str();
+}
+
+/**
+ * @brief writes lines in input order, holding back any that finish before the lines ahead of them
+ */
+class OrderedOutput{
+    public:
+    OrderedOutput(std::ostream& out): out(out) {}
+
+    /**
+     * @brief blocks until the line at index is close enough to the next one to print, so that held back lines don't pile up
+     */
+    void WaitForRoom(size_t index){
+        std::unique_lock lock(mutex);
+        room.wait(lock, [&]{return index < next_index + REORDER_WINDOW;});
+    }
+
+    void Add(size_t index, std::string line){
+        std::lock_guard lock(mutex);
+        pending.emplace(index, std::move(line));
+        while(!pending.empty() && pending.begin()->first == next_index){
+            out << pending.begin()->second << "\n";
+            pending.erase(pending.begin());
+            next_index++;
+        }
+        out.flush();//so that the results can be read as they come
+        room.notify_all();
+    }
+
+    size_t LinesWritten(){
+        std::lock_guard lock(mutex);
+        return next_index;
+    }
+
+    private:
+    std::ostream& out;
+    std::mutex mutex;
+    std::condition_variable room;
+    std::map<size_t, std::string> pending;//finished lines, waiting for the lines before them
+    size_t next_index = 0;
+};
+
+/**
+ * @brief searches one position on w
+ * @returns the output line for it
+ */
+inline std::string Analyse(Worker& w, const InputPosition& position, const Config& config){
+    std::fill(std::begin(w.current_board_search_stack), std::end(w.current_board_search_stack), SearchUtils::PlyData());//killer moves from earlier positions are kept in the stack
+    w.current_ply_before_search = w.current_board_search_stack;
+    w.repetition_table.Clear();
+    StringTools::ReadFEN(position.fen, w.current_board, w.current_ply_before_search);
+    for(bool colour : {false, true}){
+        if(BitboardUtils::PopCount(w.current_board.piece_bitboard[PieceUtils::KING] & w.current_board.colour_bitboard[colour]) != 1){
+            return position.epd + " c0 \"invalid position\";";
+        }
+    }
+    w.transposition_table.ClearTable();
+    w.leaf_nodes_searched = 0;//the node limit is only checked every 2048 nodes in total
+
+    w.stop_condition.store(false);
+    Engine::StartSearch(w, config.depth ? config.depth : Engine::MAX_SEARCH_DEPTH, config.movetime_ms ? config.movetime_ms : UINT32_MAX, 0, config.nodes);
+    return position.epd + AnalysisOpcodes(w.last_result);
+}
+
+/**
+ * @brief analyses every line of in across config.thread_count threads, writing the results to out in the same order
+ * @returns the number of lines written
+ */
+inline size_t Run(std::istream& in, std::ostream& out, const Config& config){
+    const int hash_per_thread = std::max<int>(config.hash_mb / config.thread_count, 1);
+    std::mutex input_mutex;
+    size_t next_line = 0;
+    OrderedOutput output(out);
+
+    std::vector<std::thread> threads;
+    for(unsigned t=0;t<config.thread_count;t++){
+        threads.emplace_back([&]{
+            std::atomic<bool> stop_flag = true;
+            std::unique_ptr<Worker> worker = std::make_unique<Worker>(stop_flag, hash_per_thread);
+            worker->print_info = false;
+
+            std::string line;
+            while(!CommandLine::stop_requested.load(std::memory_order_relaxed)){
+                size_t index;
+                {
+                    std::lock_guard lock(input_mutex);//lines are claimed in order, so that they can be numbered
+                    if(!std::getline(in, line)){
+                        return;
+                    }
+                    index = next_line++;
+                }
+                output.WaitForRoom(index);
+
+                const std::optional<InputPosition> position = ParseLine(line);
+                if(!position){
+                    output.Add(index, line);//blank lines and comments are passed through, so that every input line has an output line
+                    continue;
+                }
+                output.Add(index, Analyse(*worker, *position, config));
+            }
+        });
+    }
+
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    return output.LinesWritten();
+}
+
+} // namespace BatchAnalysis
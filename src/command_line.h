@@ -0,0 +1,71 @@
+#pragma once
+
+#include "threadsafe_io.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief the argument parsing and ctrl+c handling shared by the command line tools
+ */
+namespace CommandLine {
+
+inline std::atomic<bool> stop_requested = false;//set by ctrl+c, so that the running tool finishes the work it has started and exits
+
+inline void SignalHandler(int signal) {
+    if (signal == SIGINT) {
+        stop_requested.store(true);
+    }
+}
+
+/**
+ * @brief makes ctrl+c set stop_requested instead of killing the process
+ */
+inline void StopOnInterrupt(){
+    std::signal(SIGINT, SignalHandler);
+}
+
+/**
+ * @brief a "--name value" argument, and how its value is stored in the config
+ * @note parse can throw (like std::stoi does) to reject the value
+ */
+template<typename Config>
+struct Flag{
+    std::string name;
+    std::function<void(Config&, const std::string&)> parse;
+};
+
+/**
+ * @brief reads every "--name value" pair of the arguments into config
+ * @returns false (after printing why) if an argument is unknown, has no value or has a value that doesn't parse
+ */
+template<typename Config>
+bool ParseFlags(int argc, char** argv, const std::vector<Flag<Config>>& flags, const std::string& usage, Config& config){
+    for(int i=1;i<argc;i++){
+        const std::string name = argv[i];
+        if(i+1 >= argc){
+            sync_cout << "missing value for " << name << "\n" << usage << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+
+        const auto flag = std::find_if(flags.begin(), flags.end(), [&](const Flag<Config>& f){ return f.name == name; });
+        if(flag == flags.end()){
+            sync_cout << "unknown argument " << name << " " << value << "\n" << usage << std::endl;
+            return false;
+        }
+
+        try{
+            flag->parse(config, value);
+        } catch(const std::exception&){
+            sync_cout << "invalid value for " << name << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <charconv>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief pulls the fields that training data generation needs out of one line of the lichess eval dump, without building a json tree
+ * @note only fen, evals[].depth and evals[].pvs[].{cp,mate,line} are read. every other value is skipped over
+ */
+namespace LichessJson {
+
+struct PvEntry{
+    bool is_mate = false;
+    int score = 0;//centipawns, or moves to mate if is_mate
+    std::string_view line;//space separated uci moves
+};
+
+struct EvalEntry{
+    int depth = 0;
+    size_t first_pv = 0;//index into LichessEntry::pvs
+    size_t pv_count = 0;
+};
+
+/**
+ * @brief one parsed line. reuse it for every line so that the vectors keep their capacity, and nothing is allocated per line
+ * @warning the string_views point into the line that was parsed, so that line must outlive this
+ */
+struct LichessEntry{
+    std::string_view fen;
+    std::vector<EvalEntry> evals;
+    std::vector<PvEntry> pvs;
+
+    void Clear(){
+        fen = {};
+        evals.clear();
+        pvs.clear();
+    }
+};
+
+/**
+ * @brief reads json from a string_view, one token at a time
+ */
+class Scanner{
+    public:
+    Scanner(std::string_view text): text(text), pos(0) {}
+
+    /**
+     * @brief parses a whole line into entry
+     * @returns false if the line is not json this scanner understands, such as strings with escapes in the fields it keeps
+     */
+    bool ParseLine(LichessEntry& entry){
+        entry.Clear();
+        return ParseObject([&](std::string_view key){
+            if(key == "fen"){
+                return ParseString(entry.fen);
+            }
+            if(key == "evals"){
+                return ParseArray([&]{return ParseEval(entry);});
+            }
+            return SkipValue();
+        }) && AtEnd();
+    }
+
+    private:
+    bool ParseEval(LichessEntry& entry){
+        EvalEntry eval;
+        eval.first_pv = entry.pvs.size();
+        const bool ok = ParseObject([&](std::string_view key){
+            if(key == "depth"){
+                return ParseInt(eval.depth);
+            }
+            if(key == "pvs"){
+                return ParseArray([&]{return ParsePv(entry);});
+            }
+            return SkipValue();
+        });
+        eval.pv_count = entry.pvs.size() - eval.first_pv;
+        entry.evals.push_back(eval);
+        return ok;
+    }
+
+    bool ParsePv(LichessEntry& entry){
+        PvEntry pv;
+        const bool ok = ParseObject([&](std::string_view key){
+            if(key == "cp"){
+                pv.is_mate = false;
+                return ParseInt(pv.score);
+            }
+            if(key == "mate"){
+                pv.is_mate = true;
+                return ParseInt(pv.score);
+            }
+            if(key == "line"){
+                return ParseString(pv.line);
+            }
+            return SkipValue();
+        });
+        entry.pvs.push_back(pv);
+        return ok;
+    }
+
+    /**
+     * @brief parses {"key": value, ...}, calling on_key to parse each value
+     */
+    template<typename OnKey>
+    bool ParseObject(OnKey on_key){
+        if(!Consume('{')){
+            return false;
+        }
+        if(Consume('}')){
+            return true;
+        }
+        do{
+            std::string_view key;
+            if(!ParseString(key) || !Consume(':') || !on_key(key)){
+                return false;
+            }
+        } while(Consume(','));
+        return Consume('}');
+    }
+
+    /**
+     * @brief parses [value, ...], calling on_element to parse each value
+     */
+    template<typename OnElement>
+    bool ParseArray(OnElement on_element){
+        if(!Consume('[')){
+            return false;
+        }
+        if(Consume(']')){
+            return true;
+        }
+        do{
+            if(!on_element()){
+                return false;
+            }
+        } while(Consume(','));
+        return Consume(']');
+    }
+
+    /**
+     * @brief parses a string with no escapes, as a view into the text
+     */
+    bool ParseString(std::string_view& result){
+        if(!Consume('"')){
+            return false;
+        }
+        const size_t start = pos;
+        while(pos < text.size() && text[pos] != '"'){
+            if(text[pos] == '\\'){
+                return false;//the view would not match the unescaped string
+            }
+            pos++;
+        }
+        if(pos == text.size()){
+            return false;
+        }
+        result = text.substr(start, pos - start);
+        pos++;//closing quote
+        return true;
+    }
+
+    bool ParseInt(int& result){
+        SkipWhitespace();
+        const char* begin = text.data() + pos;
+        const char* end = text.data() + text.size();
+        const auto [number_end, error] = std::from_chars(begin, end, result);
+        if(error != std::errc() || (number_end != end && (*number_end == '.' || *number_end == 'e' || *number_end == 'E'))){
+            return false;//not an integer
+        }
+        pos += number_end - begin;
+        return true;
+    }
+
+    /**
+     * @brief skips any json value, including strings with escapes
+     */
+    bool SkipValue(){
+        SkipWhitespace();
+        if(pos == text.size()){
+            return false;
+        }
+        switch(text[pos]){
+            case '{':
+                return ParseObject([&](std::string_view){return SkipValue();});
+            case '[':
+                return ParseArray([&]{return SkipValue();});
+            case '"':
+                pos++;
+                while(pos < text.size() && text[pos] != '"'){
+                    pos += text[pos] == '\\' ? 2 : 1;
+                }
+                if(pos >= text.size()){
+                    return false;
+                }
+                pos++;
+                return true;
+            default:
+                //numbers, true, false and null
+                while(pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']' && !IsWhitespace(text[pos])){
+                    pos++;
+                }
+                return true;
+        }
+    }
+
+    static bool IsWhitespace(char c){
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    void SkipWhitespace(){
+        while(pos < text.size() && IsWhitespace(text[pos])){
+            pos++;
+        }
+    }
+
+    /**
+     * @returns true and moves past c if it is the next character that isn't whitespace
+     */
+    bool Consume(char c){
+        SkipWhitespace();
+        if(pos < text.size() && text[pos] == c){
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool AtEnd(){
+        SkipWhitespace();
+        return pos == text.size();
+    }
+
+    std::string_view text;
+    size_t pos;
+};
+
+} // namespace LichessJson
@@ -13,11 +13,40 @@
 
 #ifdef QUIET_GEN
 #include "quiet_gen.h"
+#include "training_shuffle.h"
+#include "packed_position.h"
 #include <cassert>
 #endif
 
+#ifdef SELF_PLAY
+#include "self_play.h"
+#endif
+
+#ifdef TEXEL_TUNER
+#include "texel_tuner.h"
+#include "Bitbase.h"
+#endif
+
+#ifdef MATCH_RUNNER
+#include "match_runner.h"
+#endif
+
+#ifdef BATCH_ANALYSIS
+#include "batch_analysis.h"
+#include "Bitbase.h"
+#endif
 
-int main() {
+#ifdef TEST_SUITE
+#include "test_suite.h"
+#include "Bitbase.h"
+#endif
+
+#ifdef RUN_TESTS
+#include "tests.h"
+#endif
+
+
+int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
 
     #ifdef RUN_UCI
 
@@ -38,27 +67,171 @@ int main() {
 
     #ifdef QUIET_GEN
 
-    std::signal(SIGINT, QuietGen::signalHandler);
+    const std::optional<QuietGen::Config> config = QuietGen::ParseArguments(argc, argv);
+    if(!config){
+        return 1;
+    }
+
+    if(!config->shuffle_path.empty()){
+        const std::optional<TrainingShuffle::ShuffleStats> stats = TrainingShuffle::ShuffleFile(config->shuffle_path, config->output_path, config->buffer_elements, config->seed);
+        if(!stats){
+            return 1;
+        }
+        sync_cout << "shuffled " << stats->positions_read << " positions into " << stats->positions_written << " unique positions" << std::endl;
+        return 0;
+    }
+
+    if(!config->pack_path.empty() || !config->unpack_path.empty()){
+        const std::optional<size_t> converted = config->pack_path.empty() ?
+            PackedPosition::UnpackFile(config->unpack_path, config->output_path) :
+            PackedPosition::PackFile(config->pack_path, config->output_path);
+        if(!converted){
+            return 1;
+        }
+        sync_cout << "converted " << *converted << " positions" << std::endl;
+        return 0;
+    }
 
-    std::string data_line;
+    const QuietGen::MappedFile in_file(config->input_path);
+    if(!in_file.IsOpen()){
+        sync_cout << "could not read " << config->input_path << std::endl;
+        return 1;
+    }
+    QuietGen::ShufflingBufferedWriter out_writer(config->output_path, config->buffer_elements, config->seed);
+    if(!out_writer.CanWrite()){
+        sync_cout << "could not write to " << config->output_path << std::endl;
+        return 1;
+    }
 
-    assert(QuietGen::in_file.is_open());
+    CommandLine::StopOnInterrupt();
 
-    sync_cout << "starting to create training data" << std::endl;
+    sync_cout << "starting to create training data with " << config->thread_count << " threads" << std::endl;
 
-    size_t idx=0;
-    
-    while(getline(QuietGen::in_file, data_line)){
-        bool success = QuietGen::HandleJsonEntry(data_line);
-        if(!success){
-            break;//stop flag set or something broke
+    const size_t lines_read = QuietGen::RunPipeline(in_file.View(), out_writer, config->thread_count, config->parse_mode);
+    sync_cout << "read " << lines_read << " lines, skipped " << QuietGen::skipped_lines.load() << " malformed lines, saved " << out_writer.EntriesSaved() << " positions" << std::endl;
+    if(config->parse_mode == QuietGen::ParseMode::VALIDATE){
+        sync_cout << QuietGen::validation_mismatches.load() << " lines parsed differently" << std::endl;
+    }
+
+    out_writer.Destruct();
+    sync_cout << (CommandLine::stop_requested.load() ? "stopped early" : "run out of training data. stopping") << std::endl;
+    #endif
+
+    #ifdef SELF_PLAY
+
+    const std::optional<SelfPlay::Config> config = SelfPlay::ParseArguments(argc, argv);
+    if(!config){
+        return 1;
+    }
+    QuietGen::ShufflingBufferedWriter out_writer(config->output_path, config->buffer_elements, config->seed);
+    if(!out_writer.CanWrite()){
+        sync_cout << "could not write to " << config->output_path << std::endl;
+        return 1;
+    }
+
+    Bitbase::Init();
+    CommandLine::StopOnInterrupt();
+    sync_cout << "playing " << config->games << " games with " << config->thread_count << " threads" << std::endl;
+
+    SelfPlay::Totals totals;
+    SelfPlay::Run(*config, out_writer, totals);
+    out_writer.Destruct();
+    sync_cout << "played " << totals.games_played.load() << " games " <<
+    "+" << totals.white_wins.load() << " =" << totals.draws.load() << " -" << totals.black_wins.load() <<
+    ", saved " << totals.positions.load() << " positions" << std::endl;
+    #endif
+
+    #ifdef TEXEL_TUNER
+
+    const std::optional<TexelTuner::Config> config = TexelTuner::ParseArguments(argc, argv);
+    if(!config){
+        return 1;
+    }
+    const std::vector<TexelTuner::TuningPosition> positions = TexelTuner::LoadPositions(config->positions_path, config->max_positions);
+    if(positions.empty()){
+        sync_cout << "no labelled positions in " << config->positions_path << std::endl;
+        return 1;
+    }
+
+    Bitbase::Init();
+    sync_cout << "tuning with " << positions.size() << " positions at depth " << config->depth << " on " << config->thread_count << " threads" << std::endl;
+    TexelTuner::Tune(positions, *config);
+    sync_cout << "wrote " << config->output_path << std::endl;
+    #endif
+
+    #ifdef MATCH_RUNNER
+
+    const std::optional<MatchRunner::Config> config = MatchRunner::ParseArguments(argc, argv);
+    if(!config){
+        return 1;
+    }
+    std::vector<std::string> openings = {MatchRunner::START_FEN};
+    if(!config->openings_path.empty()){
+        openings = MatchRunner::LoadOpenings(config->openings_path);
+        if(openings.empty()){
+            sync_cout << "no openings in " << config->openings_path << std::endl;
+            return 1;
+        }
+    }
+
+    CommandLine::StopOnInterrupt();
+    std::signal(SIGPIPE, SIG_IGN);//a crashed engine is noticed when reading from it instead
+    sync_cout << "playing " << config->games << " games from " << openings.size() << " openings, " << config->concurrency << " at a time" << std::endl;
+
+    const MatchRunner::MatchStats stats = MatchRunner::Run(*config, openings);
+    if(stats.Games() == 0){
+        return 1;
+    }
+    sync_cout << "final: " << MatchRunner::Summary(stats, *config) << std::endl;
+    #endif
+
+    #ifdef BATCH_ANALYSIS
+
+    const std::optional<BatchAnalysis::Config> config = BatchAnalysis::ParseArguments(argc, argv);
+    if(!config){
+        return 1;
+    }
+    std::ifstream in_file(config->input_path);
+    if(!in_file.is_open()){
+        sync_cout << "could not read " << config->input_path << std::endl;
+        return 1;
+    }
+    std::ofstream out_file;
+    if(!config->output_path.empty()){
+        out_file.open(config->output_path, std::ios::trunc);
+        if(!out_file.is_open()){
+            sync_cout << "could not write to " << config->output_path << std::endl;
+            return 1;
         }
-        idx++;
     }
 
-    QuietGen::out_writer.Destruct();
-    QuietGen::in_file.close();
-    sync_cout << "run out of training data. stopping" << std::endl;
+    Bitbase::Init();
+    CommandLine::StopOnInterrupt();
+    const size_t lines = BatchAnalysis::Run(in_file, config->output_path.empty() ? std::cout : out_file, *config);
+    std::cerr << "analysed " << lines << " lines with " << config->thread_count << " threads" << std::endl;//stdout may be holding the results
+    #endif
+
+    #ifdef TEST_SUITE
+
+    const std::optional<TestSuite::Config> config = TestSuite::ParseArguments(argc, argv);
+    if(!config){
+        return 1;
+    }
+    const std::vector<TestSuite::SuitePosition> positions = TestSuite::LoadSuite(config->input_path);
+    if(positions.empty()){
+        sync_cout << "no positions with bm or am opcodes in " << config->input_path << std::endl;
+        return 1;
+    }
+
+    Bitbase::Init();
+    CommandLine::StopOnInterrupt();
+    sync_cout << "running " << positions.size() << " positions on " << config->thread_count << " threads" << std::endl;
+    TestSuite::PrintSummary(TestSuite::Run(positions, *config));
+    #endif
+
+    #ifdef RUN_TESTS
+
+    return Tests::RunAll() == 0 ? 0 : 1;
     #endif
 
     return 0;
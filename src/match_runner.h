@@ -0,0 +1,549 @@
+#pragma once
+
+#include "Board.h"
+#include "MoveGenerator.h"
+#include "StringTools.h"
+#include "Timer.h"
+#include "threadsafe_io.h"
+#include "command_line.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <spawn.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern char** environ;
+
+/**
+ * @brief plays two UCI engines against each other to tell whether a change gained strength, with an SPRT to stop once it is clear
+ * @note each opening is played twice with colours swapped. games run on their own pair of engine processes per thread,
+ * and the runner keeps its own board to check every move, so a broken engine can't report a false result
+ */
+namespace MatchRunner {
+
+const std::string START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+constexpr int MAX_GAME_PLIES = 600;//games this long are called a draw, well within BoardUtils::MAX_GAME_LENGTH
+constexpr uint64_t STARTUP_TIMEOUT_MS = 10'000;//for uciok and readyok
+constexpr uint64_t REPLY_MARGIN_MS = 5000;//extra time an engine gets to send bestmove after its movetime, before it loses
+constexpr uint64_t UNTIMED_REPLY_MS = 60'000;//how long a node or depth limited search can take before it loses
+constexpr double CONFIDENCE_Z = 1.96;//95% error bars
+
+/**
+ * @brief settings from the command line
+ */
+struct Config{
+    std::string engine_paths[2];//the first engine is the one being tested, and results are from its point of view
+    std::string openings_path;//when empty, every game starts from the start position
+    size_t games = 200;
+    unsigned concurrency = 1;//games played at once, each with its own two engine processes
+    uint64_t nodes = 0;
+    uint64_t movetime_ms = 0;
+    int depth = 0;
+    int hash_mb = 16;
+    double elo0 = 0;//SPRT hypotheses, in logistic elo
+    double elo1 = 5;
+    double alpha = 0.05;
+    double beta = 0.05;
+};
+
+const std::string USAGE = "usage: main --engine1 <path> --engine2 <path> [--openings <epd>] [--games <count>] [--concurrency <count>] "
+    "[--nodes <count> | --movetime <ms> | --depth <ply>] [--hash <MB>] [--elo0 <elo>] [--elo1 <elo>] [--alpha <p>] [--beta <p>]";
+
+const std::vector<CommandLine::Flag<Config>> FLAGS = {
+    {"--engine1",     [](Config& config, const std::string& value){ config.engine_paths[0] = value; }},
+    {"--engine2",     [](Config& config, const std::string& value){ config.engine_paths[1] = value; }},
+    {"--openings",    [](Config& config, const std::string& value){ config.openings_path = value; }},
+    {"--games",       [](Config& config, const std::string& value){ config.games = std::max<size_t>(std::stoull(value), 1); }},
+    {"--concurrency", [](Config& config, const std::string& value){ config.concurrency = std::max(std::stoi(value), 1); }},
+    {"--nodes",       [](Config& config, const std::string& value){ config.nodes = std::max<uint64_t>(std::stoull(value), 1); }},
+    {"--movetime",    [](Config& config, const std::string& value){ config.movetime_ms = std::max<uint64_t>(std::stoull(value), 1); }},
+    {"--depth",       [](Config& config, const std::string& value){ config.depth = std::max(std::stoi(value), 1); }},
+    {"--hash",        [](Config& config, const std::string& value){ config.hash_mb = std::max(std::stoi(value), 1); }},
+    {"--elo0",        [](Config& config, const std::string& value){ config.elo0 = std::stod(value); }},
+    {"--elo1",        [](Config& config, const std::string& value){ config.elo1 = std::stod(value); }},
+    {"--alpha",       [](Config& config, const std::string& value){ config.alpha = std::clamp(std::stod(value), 1e-6, 0.5); }},
+    {"--beta",        [](Config& config, const std::string& value){ config.beta = std::clamp(std::stod(value), 1e-6, 0.5); }},
+};
+
+/**
+ * @returns the settings, or nullopt (after printing why) if the arguments are wrong
+ */
+inline std::optional<Config> ParseArguments(int argc, char** argv){
+    Config config;
+    if(!CommandLine::ParseFlags(argc, argv, FLAGS, USAGE, config)){
+        return std::nullopt;
+    }
+
+    if(config.engine_paths[0].empty() || config.engine_paths[1].empty()){
+        sync_cout << "both engines are needed\n" << USAGE << std::endl;
+        return std::nullopt;
+    }
+    if((config.nodes != 0) + (config.movetime_ms != 0) + (config.depth != 0) > 1){
+        sync_cout << "only one of --nodes, --movetime and --depth can be used" << std::endl;
+        return std::nullopt;
+    }
+    if(config.nodes == 0 && config.movetime_ms == 0 && config.depth == 0){
+        config.nodes = 20'000;
+    }
+    if(config.elo1 <= config.elo0){
+        sync_cout << "--elo1 must be bigger than --elo0" << std::endl;
+        return std::nullopt;
+    }
+    return config;
+}
+
+/**
+ * @brief reads the openings, using the first four fields of each line so that both EPD and FEN files work
+ */
+inline std::vector<std::string> LoadOpenings(const std::string& path){
+    std::vector<std::string> openings;
+    std::ifstream file(path);
+    std::string line;
+    while(std::getline(file, line)){
+        std::istringstream fields(line);
+        std::string placement, turn, castling, enpassant;
+        if(fields >> placement >> turn >> castling >> enpassant){
+            openings.push_back(placement + " " + turn + " " + castling + " " + enpassant + " 0 1");
+        }
+    }
+    return openings;
+}
+
+/**
+ * @brief a UCI engine running as a child process, talked to through pipes
+ */
+class EngineProcess{
+    public:
+    EngineProcess() = default;
+    EngineProcess(const EngineProcess&) = delete;
+    EngineProcess& operator=(const EngineProcess&) = delete;
+    ~EngineProcess(){Stop();}
+
+    /**
+     * @brief starts the engine and waits until it is ready to search
+     * @returns false if it could not be started, or did not answer
+     */
+    bool Start(const std::string& path, int hash_mb){
+        Stop();
+        int to_child[2], from_child[2];
+        if(pipe2(to_child, O_CLOEXEC) != 0){
+            return false;
+        }
+        if(pipe2(from_child, O_CLOEXEC) != 0){
+            close(to_child[0]);
+            close(to_child[1]);
+            return false;
+        }
+
+        //dup2 clears O_CLOEXEC on the new descriptors, so only stdin and stdout are passed on
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, to_child[0], STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, from_child[1], STDOUT_FILENO);
+        char* const child_argv[] = {const_cast<char*>(path.c_str()), nullptr};
+        const bool spawned = posix_spawn(&pid, path.c_str(), &actions, nullptr, child_argv, environ) == 0;
+        posix_spawn_file_actions_destroy(&actions);
+
+        close(to_child[0]);
+        close(from_child[1]);
+        to_engine = to_child[1];
+        from_engine = from_child[0];
+        if(!spawned){
+            pid = -1;
+            Stop();
+            return false;
+        }
+
+        Send("uci");
+        if(!WaitFor("uciok", STARTUP_TIMEOUT_MS)){
+            return false;
+        }
+        Send("setoption name Hash value " + std::to_string(hash_mb));
+        return NewGame();
+    }
+
+    /**
+     * @brief clears the engine's state from the last game
+     */
+    bool NewGame(){
+        Send("ucinewgame");
+        Send("isready");
+        return WaitFor("readyok", STARTUP_TIMEOUT_MS).has_value();
+    }
+
+    void Send(const std::string& line){
+        const std::string message = line + "\n";
+        size_t written = 0;
+        while(to_engine >= 0 && written < message.size()){
+            const ssize_t result = write(to_engine, message.data() + written, message.size() - written);
+            if(result < 0 && errno == EINTR){
+                continue;
+            }
+            if(result <= 0){
+                return;//the engine has gone, which the next read will notice
+            }
+            written += result;
+        }
+    }
+
+    /**
+     * @returns the next line the engine prints, or nullopt if it exits or takes longer than timeout_ms
+     */
+    std::optional<std::string> ReadLine(uint64_t timeout_ms){
+        TimePoint give_up(timeout_ms);
+        while(true){
+            const size_t newline = buffer.find('\n');
+            if(newline != std::string::npos){
+                std::string line = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                if(!line.empty() && line.back() == '\r'){
+                    line.pop_back();
+                }
+                return line;
+            }
+            if(from_engine < 0 || give_up.NowIsPastTimePoint()){
+                return std::nullopt;
+            }
+
+            pollfd poll_fd = {from_engine, POLLIN, 0};
+            const int ready = poll(&poll_fd, 1, 100);//short waits so that the timeout is checked often
+            if(ready < 0 && errno != EINTR){
+                return std::nullopt;
+            }
+            if(ready <= 0){
+                continue;
+            }
+            char chunk[4096];
+            const ssize_t bytes = read(from_engine, chunk, sizeof(chunk));
+            if(bytes < 0 && errno == EINTR){
+                continue;
+            }
+            if(bytes <= 0){
+                return std::nullopt;//the engine exited
+            }
+            buffer.append(chunk, bytes);
+        }
+    }
+
+    /**
+     * @brief reads lines until one starts with prefix
+     * @returns that line, or nullopt if it didn't come in time
+     */
+    std::optional<std::string> WaitFor(const std::string& prefix, uint64_t timeout_ms){
+        TimePoint give_up(timeout_ms);
+        while(true){
+            std::optional<std::string> line = ReadLine(timeout_ms);
+            if(!line || line->starts_with(prefix)){
+                return line;
+            }
+            if(give_up.NowIsPastTimePoint()){
+                return std::nullopt;//the engine keeps talking without answering
+            }
+        }
+    }
+
+    bool IsRunning() const {return pid > 0;}
+
+    /**
+     * @brief asks the engine to quit, killing it if it does not
+     */
+    void Stop(){
+        if(pid > 0){
+            Send("quit");
+        }
+        if(to_engine >= 0){
+            close(to_engine);
+            to_engine = -1;
+        }
+        if(from_engine >= 0){
+            close(from_engine);
+            from_engine = -1;
+        }
+        if(pid > 0){
+            int status;
+            bool exited = false;
+            for(int i=0; i<20 && !exited; i++){
+                exited = waitpid(pid, &status, WNOHANG) == pid;
+                if(!exited){
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
+            }
+            if(!exited){
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+            }
+            pid = -1;
+        }
+        buffer.clear();
+    }
+
+    private:
+    pid_t pid = -1;
+    int to_engine = -1;
+    int from_engine = -1;
+    std::string buffer;//read but not yet returned
+};
+
+/**
+ * @brief how a game ended, from white's point of view
+ */
+struct GameResult{
+    int white_score = 0;//1 for a win, 0 for a draw, -1 for a loss
+    std::string reason;
+    bool engine_failed[2] = {false, false};//indexed by colour, so that the runner can restart a broken engine
+};
+
+/**
+ * @returns true if neither side has enough pieces to mate
+ */
+inline bool InsufficientMaterial(const Board& board){
+    const Bitboard heavy_pieces = board.piece_bitboard[PieceUtils::PAWN] | board.piece_bitboard[PieceUtils::ROOK] | board.piece_bitboard[PieceUtils::QUEEN];
+    const Bitboard minor_pieces = board.piece_bitboard[PieceUtils::KNIGHT] | board.piece_bitboard[PieceUtils::BISHOP];
+    return heavy_pieces == 0 && BitboardUtils::PopCount(minor_pieces) <= 1;
+}
+
+/**
+ * @returns true if the position has come up twice before since the last capture or pawn move
+ */
+inline bool IsThreefoldRepetition(const std::vector<uint64_t>& earlier_positions, const SearchUtils::PlyData* ply_data){
+    const size_t reversible_plies = std::min<size_t>(ply_data->fifty_move_rule, earlier_positions.size());
+    return std::count(earlier_positions.end() - reversible_plies, earlier_positions.end(), ply_data->zobrist) >= 2;
+}
+
+inline std::string GoCommand(const Config& config){
+    if(config.movetime_ms){
+        return "go movetime " + std::to_string(config.movetime_ms);
+    }
+    if(config.depth){
+        return "go depth " + std::to_string(config.depth);
+    }
+    return "go nodes " + std::to_string(config.nodes);
+}
+
+/**
+ * @brief plays one game from opening_fen, checking every move against the legal moves
+ * @param engines the engines playing black and white, indexed by colour like Board::turn
+ */
+inline GameResult PlayGame(EngineProcess* engines[2], const std::string& opening_fen, const Config& config){
+    GameResult result;
+    std::vector<SearchUtils::PlyData> ply_stack(MAX_GAME_PLIES + 1);
+    std::vector<uint64_t> earlier_positions;
+    Board board;
+    StringTools::ReadFEN(opening_fen, board, ply_stack.data());
+
+    const std::string position_command = "position fen " + opening_fen + " moves";
+    std::string moves;
+    const std::string go_command = GoCommand(config);
+    const uint64_t reply_timeout_ms = config.movetime_ms ? config.movetime_ms + REPLY_MARGIN_MS : UNTIMED_REPLY_MS;
+    Move move_list[MoveGenerator::MAX_MOVE_COUNT];
+
+    for(int ply=0;;ply++){
+        SearchUtils::PlyData* ply_data = &ply_stack[ply];
+        const bool white_to_move = board.turn;
+        const int loss_for_mover = white_to_move ? -1 : 1;
+
+        Move* end = white_to_move ?
+            MoveGenerator::GenerateMain<true, MoveGenerator::ALL_MOVES>(board, ply_data, move_list) :
+            MoveGenerator::GenerateMain<false, MoveGenerator::ALL_MOVES>(board, ply_data, move_list);
+        if(end == move_list){
+            result.white_score = ply_data->in_check ? loss_for_mover : 0;
+            result.reason = ply_data->in_check ? "checkmate" : "stalemate";
+            return result;
+        }
+        if(ply_data->fifty_move_rule >= 100){
+            result.reason = "fifty move rule";
+            return result;
+        }
+        if(IsThreefoldRepetition(earlier_positions, ply_data)){
+            result.reason = "repetition";
+            return result;
+        }
+        if(InsufficientMaterial(board)){
+            result.reason = "insufficient material";
+            return result;
+        }
+        if(ply == MAX_GAME_PLIES){
+            result.reason = "game too long";
+            return result;
+        }
+
+        EngineProcess& engine = *engines[white_to_move];
+        engine.Send(position_command + moves);
+        engine.Send(go_command);
+        const std::optional<std::string> reply = engine.WaitFor("bestmove", reply_timeout_ms);
+        if(!reply){
+            result.white_score = loss_for_mover;
+            result.reason = "no reply";
+            result.engine_failed[white_to_move] = true;
+            return result;
+        }
+
+        std::istringstream reply_stream(*reply);
+        std::string bestmove, move_text;
+        reply_stream >> bestmove >> move_text;
+        Move* played = std::find_if(move_list, end, [&](Move m){return StringTools::MoveToString(m) == move_text;});
+        if(played == end){
+            result.white_score = loss_for_mover;
+            result.reason = "illegal move " + move_text;
+            return result;
+        }
+
+        earlier_positions.push_back(ply_data->zobrist);
+        BoardUtils::MakeMove(board, *played, ply_data);
+        moves += " " + move_text;
+    }
+}
+
+/**
+ * @brief wins, draws and losses of the first engine, with the statistics worked out from them
+ */
+struct MatchStats{
+    size_t wins = 0;
+    size_t draws = 0;
+    size_t losses = 0;
+
+    size_t Games() const {return wins + draws + losses;}
+
+    double Score() const {return (wins + 0.5*draws) / Games();}
+
+    /**
+     * @returns the variance of one game's score
+     */
+    double Variance() const {
+        const double score = Score();
+        return (wins * std::pow(1 - score, 2) + draws * std::pow(0.5 - score, 2) + losses * std::pow(score, 2)) / Games();
+    }
+};
+
+/**
+ * @returns the elo difference that gives an expected score, which is infinite for a score of 0 or 1
+ */
+inline double EloFromScore(double score){
+    return 400 * std::log10(score / (1 - score));
+}
+
+inline double ScoreFromElo(double elo){
+    return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+/**
+ * @returns the log likelihood ratio of elo1 against elo0, using the normal approximation to the game results
+ */
+inline double LogLikelihoodRatio(const MatchStats& stats, double elo0, double elo1){
+    const double variance = stats.Variance();
+    if(stats.Games() == 0 || variance <= 0){
+        return 0;//every game had the same result, so there isn't enough to go on yet
+    }
+    const double score0 = ScoreFromElo(elo0);
+    const double score1 = ScoreFromElo(elo1);
+    return stats.Games() * (score1 - score0) * (2 * stats.Score() - score0 - score1) / (2 * variance);
+}
+
+/**
+ * @brief one line describing the match so far
+ */
+inline std::string Summary(const MatchStats& stats, const Config& config){
+    const double score = stats.Score();
+    const double margin = CONFIDENCE_Z * std::sqrt(stats.Variance() / stats.Games());
+    const double elo = EloFromScore(score);
+    const double error = (EloFromScore(std::min(score + margin, 1.0)) - EloFromScore(std::max(score - margin, 0.0))) / 2;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) <<
+    "+" << stats.wins << " =" << stats.draws << " -" << stats.losses <<
+    " elo " << elo << " +- " << error <<
+    std::setprecision(2) << " LLR " << LogLikelihoodRatio(stats, config.elo0, config.elo1) <<
+    " [" << std::log(config.beta / (1 - config.alpha)) << ", " << std::log((1 - config.beta) / config.alpha) << "]";
+    return out.str();
+}
+
+/**
+ * @brief plays the match across config.concurrency threads, stopping early once the SPRT has decided
+ * @returns the final results
+ */
+inline MatchStats Run(const Config& config, const std::vector<std::string>& openings){
+    const double lower_bound = std::log(config.beta / (1 - config.alpha));
+    const double upper_bound = std::log((1 - config.beta) / config.alpha);
+    std::atomic<size_t> next_game = 0;
+    std::atomic<bool> decided = false;
+    MatchStats stats;
+    std::mutex stats_mutex;
+
+    std::vector<std::thread> threads;
+    for(unsigned i=0;i<config.concurrency;i++){
+        threads.emplace_back([&]{
+            std::unique_ptr<EngineProcess> engines[2] = {std::make_unique<EngineProcess>(), std::make_unique<EngineProcess>()};
+            for(int e=0;e<2;e++){
+                if(!engines[e]->Start(config.engine_paths[e], config.hash_mb)){
+                    sync_cout << "could not start " << config.engine_paths[e] << std::endl;
+                    CommandLine::stop_requested.store(true);
+                    return;
+                }
+            }
+
+            for(size_t game = next_game++; game < config.games && !decided.load() && !CommandLine::stop_requested.load(); game = next_game++){
+                const std::string& opening = openings[(game / 2) % openings.size()];
+                const bool first_engine_is_white = game % 2 == 0;//each opening is played from both sides
+                EngineProcess* by_colour[2] = {
+                    engines[first_engine_is_white ? 1 : 0].get(),
+                    engines[first_engine_is_white ? 0 : 1].get()
+                };
+
+                bool ready = true;
+                for(int e=0;e<2;e++){
+                    ready = ready && (engines[e]->NewGame() || engines[e]->Start(config.engine_paths[e], config.hash_mb));
+                }
+                if(!ready){
+                    sync_cout << "an engine stopped answering and could not be restarted" << std::endl;
+                    CommandLine::stop_requested.store(true);
+                    return;
+                }
+
+                const GameResult result = PlayGame(by_colour, opening, config);
+                const int first_engine_score = first_engine_is_white ? result.white_score : -result.white_score;
+                for(int colour=0;colour<2;colour++){
+                    if(result.engine_failed[colour]){
+                        const int e = (colour == 1) == first_engine_is_white ? 0 : 1;
+                        engines[e]->Start(config.engine_paths[e], config.hash_mb);//a failed start is caught before the next game
+                    }
+                }
+
+                std::lock_guard lock(stats_mutex);
+                (first_engine_score > 0 ? stats.wins : first_engine_score < 0 ? stats.losses : stats.draws)++;
+                const double llr = LogLikelihoodRatio(stats, config.elo0, config.elo1);
+                sync_cout << "game " << game + 1 << ": engine1 as " << (first_engine_is_white ? "white" : "black") << " " <<
+                (first_engine_score > 0 ? "won" : first_engine_score < 0 ? "lost" : "drew") << " by " << result.reason << ". " <<
+                Summary(stats, config) << std::endl;
+
+                if(!decided.load() && (llr <= lower_bound || llr >= upper_bound)){
+                    decided.store(true);
+                    const bool accepted_h1 = llr >= upper_bound;
+                    sync_cout << "SPRT accepted " << (accepted_h1 ? "H1" : "H0") << ": elo " << (accepted_h1 ? config.elo1 : config.elo0) <<
+                    " is more likely than elo " << (accepted_h1 ? config.elo0 : config.elo1) << std::endl;
+                }
+            }
+        });
+    }
+
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    return stats;
+}
+
+} // namespace MatchRunner
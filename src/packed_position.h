@@ -0,0 +1,251 @@
+#pragma once
+
+#include "training_data.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief a smaller file format for training data, holding the same positions as QuietGen::DataPoint in 26 bytes instead of 62
+ * @note a file starts with a FileHeader, followed by PackedDataPoints
+ */
+namespace PackedPosition {
+
+constexpr uint32_t MAGIC = 0x4b50424d;//"MBPK" when read as little endian bytes
+constexpr uint16_t VERSION = 1;
+constexpr int MAX_PIECES = 32;
+constexpr float SCORE_SCALE = 32767;//tanh scores are in [-1, 1], so this uses the whole of an int16
+constexpr size_t READ_BUFFER_ENTRIES = 4096;
+
+#pragma pack(push,1)
+struct FileHeader{
+    uint32_t magic = MAGIC;
+    uint16_t version = VERSION;
+    uint16_t entry_size;//so that a reader can reject a file written with a different layout
+};
+
+struct PackedDataPoint{
+    Bitboard occupancy;
+    uint8_t pieces[MAX_PIECES / 2];//a 4 bit piece code (base piece, plus WHITE_FLAG for colour 1) per occupied square in LSB first order. low nibble first
+    int16_t score;//tanh_score * SCORE_SCALE
+};
+#pragma pack(pop)
+
+static_assert(sizeof(PackedDataPoint) == 26);
+
+inline int16_t QuantizeScore(float tanh_score){
+    return (int16_t)std::lround(std::clamp(tanh_score, -1.0f, 1.0f) * SCORE_SCALE);
+}
+
+inline float DequantizeScore(int16_t score){
+    return score / SCORE_SCALE;
+}
+
+/**
+ * @returns the piece code of the square for a data point, which must be occupied
+ */
+inline uint8_t PieceCode(const QuietGen::DataPoint& dp, Square s){
+    const int colour = BitboardUtils::ContainsBit(dp.colours[1], s) ? 1 : 0;
+    const Piece colour_offset = colour ? PieceUtils::WHITE_FLAG : 0;
+    for(Piece p=0;p<5;p++){
+        if(BitboardUtils::ContainsBit(dp.non_king_pieces[p], s)){
+            return p + colour_offset;
+        }
+    }
+    return PieceUtils::KING + colour_offset;//only kings are not in non_king_pieces
+}
+
+/**
+ * @returns the packed data point, or nullopt if it has more pieces than fit in PackedDataPoint::pieces
+ */
+inline std::optional<PackedDataPoint> Encode(const QuietGen::DataPoint& dp){
+    PackedDataPoint packed{};
+    packed.occupancy = dp.colours[0] | dp.colours[1];
+    packed.score = QuantizeScore(dp.tanh_score);
+
+    Bitboard remaining = packed.occupancy;
+    if(BitboardUtils::PopCount(remaining) > MAX_PIECES){
+        return std::nullopt;//only possible from a corrupt data point
+    }
+    for(int i=0; remaining; i++){
+        const uint8_t code = PieceCode(dp, BitboardUtils::FindLSB(remaining));
+        packed.pieces[i/2] |= (i % 2 == 0) ? code : (code << 4);
+        remaining &= remaining - 1;
+    }
+    return packed;
+}
+
+inline QuietGen::DataPoint Decode(const PackedDataPoint& packed){
+    QuietGen::DataPoint dp{};
+    dp.tanh_score = DequantizeScore(packed.score);
+
+    Bitboard remaining = packed.occupancy;
+    for(int i=0; remaining; i++){
+        const Square s = BitboardUtils::FindLSB(remaining);
+        const uint8_t code = (i % 2 == 0) ? (packed.pieces[i/2] & 0xF) : (packed.pieces[i/2] >> 4);
+        const int colour = code >= PieceUtils::WHITE_FLAG ? 1 : 0;
+        const Piece base_piece = code - (colour ? PieceUtils::WHITE_FLAG : 0);
+
+        BitboardUtils::AddSquare(dp.colours[colour], s);
+        if(base_piece == PieceUtils::KING){
+            dp.king_xy[colour] = SquareUtils::ToFile(s) << 4 | SquareUtils::ToRank(s);
+        } else {
+            BitboardUtils::AddSquare(dp.non_king_pieces[base_piece], s);
+        }
+        remaining &= remaining - 1;
+    }
+    return dp;
+}
+
+/**
+ * @brief writes data points to a packed file
+ */
+class Writer{
+    public:
+    Writer(const std::string& path): out_file(path, std::ios::binary | std::ios::trunc) {
+        FileHeader header;
+        header.entry_size = sizeof(PackedDataPoint);
+        out_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    bool IsOpen() const {return out_file.is_open();}
+
+    /**
+     * @returns false if the data point can't be packed, in which case nothing is written
+     */
+    bool Write(const QuietGen::DataPoint& dp){
+        const std::optional<PackedDataPoint> packed = Encode(dp);
+        if(!packed){
+            return false;
+        }
+        out_file.write(reinterpret_cast<const char*>(&*packed), sizeof(*packed));
+        return true;
+    }
+
+    /**
+     * @brief flushes everything written so far
+     * @returns false if any write failed, such as when the disk is full
+     */
+    bool Finish(){
+        out_file.flush();
+        return out_file.good();
+    }
+
+    private:
+    std::ofstream out_file;
+};
+
+/**
+ * @brief reads a packed file back as data points, so code that used the DataPoint format can read either
+ */
+class Reader{
+    public:
+    Reader(const std::string& path): in_file(path, std::ios::binary) {
+        FileHeader header;
+        valid = in_file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+            header.magic == MAGIC && header.version == VERSION && header.entry_size == sizeof(PackedDataPoint);
+        buffer.reserve(READ_BUFFER_ENTRIES);
+    }
+
+    /**
+     * @returns false if the file is missing, or was not written by a matching Writer
+     */
+    bool IsValid() const {return valid;}
+
+    /**
+     * @brief decodes the next data point into dp
+     * @returns false at the end of the file
+     */
+    bool Next(QuietGen::DataPoint& dp){
+        if(next_index == buffer.size() && !Refill()){
+            return false;
+        }
+        dp = Decode(buffer[next_index++]);
+        return true;
+    }
+
+    private:
+    bool Refill(){
+        if(!valid){
+            return false;
+        }
+        buffer.resize(READ_BUFFER_ENTRIES);
+        in_file.read(reinterpret_cast<char*>(buffer.data()), READ_BUFFER_ENTRIES * sizeof(PackedDataPoint));
+        buffer.resize(in_file.gcount() / sizeof(PackedDataPoint));//a partly written last entry is dropped
+        next_index = 0;
+        return !buffer.empty();
+    }
+
+    std::ifstream in_file;
+    bool valid;
+    std::vector<PackedDataPoint> buffer;
+    size_t next_index = 0;
+};
+
+/**
+ * @brief converts a file of QuietGen::DataPoints into a packed file, skipping any that can't be packed
+ * @returns the number of positions converted, or nullopt if a file could not be used
+ */
+inline std::optional<size_t> PackFile(const std::string& in_path, const std::string& out_path){
+    const QuietGen::MappedFile in_file(in_path);
+    if(!in_file.IsOpen() || in_file.View().size() % sizeof(QuietGen::DataPoint) != 0){
+        sync_cout << in_path << " is missing or is not a whole number of data points" << std::endl;
+        return std::nullopt;
+    }
+    Writer writer(out_path);
+    if(!writer.IsOpen()){
+        sync_cout << "could not write to " << out_path << std::endl;
+        return std::nullopt;
+    }
+
+    const QuietGen::DataPoint* input = reinterpret_cast<const QuietGen::DataPoint*>(in_file.View().data());//packed, so any address is aligned
+    const size_t count = in_file.View().size() / sizeof(QuietGen::DataPoint);
+    size_t written = 0;
+    for(size_t i=0;i<count;i++){
+        written += writer.Write(input[i]);
+    }
+    if(!writer.Finish()){
+        sync_cout << "could not write all of " << out_path << std::endl;
+        return std::nullopt;
+    }
+    if(written != count){
+        sync_cout << "skipped " << count - written << " data points with more than " << MAX_PIECES << " pieces" << std::endl;
+    }
+    return written;
+}
+
+/**
+ * @brief converts a packed file back into QuietGen::DataPoints, for tools that only read the old format
+ * @returns the number of positions converted, or nullopt if a file could not be used
+ */
+inline std::optional<size_t> UnpackFile(const std::string& in_path, const std::string& out_path){
+    Reader reader(in_path);
+    if(!reader.IsValid()){
+        sync_cout << in_path << " is missing or is not a packed training data file of version " << VERSION << std::endl;
+        return std::nullopt;
+    }
+    std::ofstream out_file(out_path, std::ios::binary | std::ios::trunc);
+    if(!out_file.is_open()){
+        sync_cout << "could not write to " << out_path << std::endl;
+        return std::nullopt;
+    }
+
+    size_t count = 0;
+    QuietGen::DataPoint dp;
+    while(reader.Next(dp)){
+        out_file.write(reinterpret_cast<const char*>(&dp), sizeof(dp));
+        count++;
+    }
+    out_file.flush();
+    if(!out_file.good()){
+        sync_cout << "could not write all of " << out_path << std::endl;
+        return std::nullopt;
+    }
+    return count;
+}
+
+} // namespace PackedPosition
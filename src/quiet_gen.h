@@ -5,6 +5,7 @@
 #include "MoveGenerator.h"
 #include "nn_lib_helpers.h"
 #include "threadsafe_io.h"
+#include "command_line.h"
 #include <sstream>
 #include <cmath>
 #include <format>
@@ -14,164 +15,186 @@
 #include <cctype>
 #include <algorithm>
 #include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <vector>
+#include <cstring>
+#include <string_view>
+#include <stdexcept>
 
 #include "nlohmann/json.hpp"
+#include "lichess_json.h"
+#include "training_data.h"
+#include "Timer.h"
+#include <iomanip>
 
 namespace QuietGen {
     //structs
 
-    #pragma pack(push,1)//prevent compiler from messing with my struct alignment
-    struct DataPoint {
-        DataPoint(const Board& board, float tanh_input):
-        tanh_score(tanh_input)
-        {
-            //store colour bitboards
-            colours[0] = board.colour_bitboard[0];
-            colours[1] = board.colour_bitboard[1];
-
-            //store non king bitboards
-            for(Piece p = 0; p < 5; p++){// N B R Q P
-                non_king_pieces[p] = board.piece_bitboard[p];
-            }
-
-            //store king positions
-            for(int i=0;i<2;i++){
-                SetKingPos(board.piece_bitboard[PieceUtils::KING] & board.colour_bitboard[i], i);
-            }
-        }
-        //TODO order these better, but don't mess up the training data
-        float tanh_score;
-        uint8_t king_xy[2];//[colour] upper nibble is x, lower nibble is y
-        Bitboard colours[2];//[colour]
-        Bitboard non_king_pieces[5];//bitboards for non king pieces, indexed [base piece]
-
-        private:
-        void SetKingPos(Bitboard king_bb, bool colour){
-            assert(BitboardUtils::PopCount(king_bb) == 1);
-            Square king_pos = BitboardUtils::FindLSB(king_bb);
-            Square x = SquareUtils::ToFile(king_pos);
-            assert(x < 8);
-            Square y = SquareUtils::ToRank(king_pos);
-            assert(y < 8);
-            king_xy[colour] = (x<<4 | y);
-        }
-    };
-    #pragma pack(pop)
-
-    class ShufflingBufferedWriter {
+    /**
+     * @brief a bounded queue for passing batches between the stages of the pipeline
+     */
+    template<typename T>
+    class BlockingQueue {
         public:
-        ShufflingBufferedWriter(size_t max_elements):
-        out_file("/home/stuart/ChessTrainingData/nn_training_data.bin", std::iostream::binary | std::iostream::trunc),
-        write_buffer(),
-        can_save_training_data(true),
-        max_elements(max_elements)
-        {
-            write_buffer.reserve(max_elements);
-            assert(write_buffer.size() == 0);
-            assert(write_buffer.capacity() == max_elements);
-        }
+        BlockingQueue(size_t capacity): capacity(capacity), closed(false) {}
 
         /**
-         * @warning not thread-safe with other writes
+         * @brief waits until there is room, then adds the item
          */
-        void SaveEntry(const DataPoint& dp){
-            write_buffer.push_back(dp);
-            if(write_buffer.size() == max_elements){
-                ShuffleWrite();
-            }
+        void Push(T item){
+            std::unique_lock lock(mutex);
+            not_full.wait(lock, [this]{return items.size() < capacity;});
+            items.push_back(std::move(item));
+            not_empty.notify_one();
         }
 
-        bool CanWrite() const {return can_save_training_data.load();}
-
         /**
-         * @note can be called from multi_threads
+         * @brief waits for an item
+         * @returns the item, or nullopt once the queue is closed and empty
          */
-        void Destruct(){
-            if(can_save_training_data.load() == false){
-                return;//already done
+        std::optional<T> Pop(){
+            std::unique_lock lock(mutex);
+            not_empty.wait(lock, [this]{return !items.empty() || closed;});
+            if(items.empty()){
+                return std::nullopt;
             }
-            can_save_training_data = false;
-            ShuffleWrite();
-
-            out_file.close();
+            T item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return item;
         }
 
-        ~ShufflingBufferedWriter(){
-            Destruct();
+        /**
+         * @brief wakes up everything waiting to pop, as nothing else will be pushed
+         */
+        void Close(){
+            std::lock_guard lock(mutex);
+            closed = true;
+            not_empty.notify_all();
         }
 
         private:
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed;
+    };
 
-        void ShuffleWrite(){
-            sync_cout << "shuffling segment" << std::endl;
-            auto rng = std::default_random_engine {};
-
-            std::ranges::shuffle(write_buffer, rng);
-
-            out_file.write((const char*)write_buffer.data(), write_buffer.size() * sizeof(DataPoint));//don't ask. it works on my machine...
-
-            write_buffer.clear();
+    //pipeline sizes. batches are big enough that the queue locks are rarely touched
+    constexpr size_t LINES_PER_BATCH = 256;
+    constexpr size_t BATCHES_PER_THREAD = 4;//how many batches can wait in the output queue, per worker thread
+    constexpr size_t CHUNK_BYTES = 4 << 20;//the input is split into chunks of about this size, ending on a newline, for workers to claim
+    constexpr uint64_t PROGRESS_INTERVAL_MS = 5000;
 
-            sync_cout << "done shuffling" << std::endl;
+    //functions
 
-        }
+    using json = nlohmann::json;
 
-        std::ofstream out_file;
-        std::vector<DataPoint> write_buffer;
-        std::atomic<bool> can_save_training_data;
-        size_t max_elements;
+    /**
+     * @brief which json parser to read the lichess dump with
+     */
+    enum class ParseMode{
+        STREAMING,//LichessJson::Scanner, falling back to nlohmann for lines it can't read
+        NLOHMANN,//build a full json tree for every line, which is much slower
+        VALIDATE,//parse with both, and count any line where the training data differs
     };
-    
-
-    //global variables
-    std::ifstream in_file("/home/stuart/ChessTrainingData/lichess_evals.json");
-    ShufflingBufferedWriter out_writer = ShufflingBufferedWriter(8'064'516);//roughly every 500MB
 
-    Board board;
-
-    //functions
+    /**
+     * @throws std::invalid_argument if the name isn't one of the modes
+     */
+    inline ParseMode ParseParseMode(const std::string& name){
+        if(name == "streaming"){
+            return ParseMode::STREAMING;
+        }
+        if(name == "nlohmann"){
+            return ParseMode::NLOHMANN;
+        }
+        if(name == "validate"){
+            return ParseMode::VALIDATE;
+        }
+        throw std::invalid_argument(name);
+    }
 
-    using json = nlohmann::json;
+    std::atomic<size_t> validation_mismatches = 0;
+    std::atomic<size_t> skipped_lines = 0;//lines that are not valid json, or are missing a field
 
-    static std::optional<float> GetTanhScore(const json& pv){
-        if(pv.contains("mate")){
-            int mate_in = pv["mate"];
+    static std::optional<float> GetTanhScore(const LichessJson::PvEntry& pv){
+        if(pv.is_mate){
+            int mate_in = pv.score;
             if(std::abs(mate_in) <= 4){
                 return std::nullopt;//my engine should mate find an 8 ply mate, so wouldn't make good training data
             }
             return (mate_in > 0) ? 1 : -1;//really?
         }
 
-        float cp_score = pv["cp"];
+        float cp_score = pv.score;
         return std::tanh(cp_score/200);
     }
 
-    inline bool HandleJsonEntry(std::string json_data){
-        json data = json::parse(json_data);
-
-        std::string fen = data["fen"];
+    /**
+     * @brief fills entry from a json tree
+     * @throws json::exception if a field is missing or has the wrong type
+     * @warning the string_views in entry point into data, so data must outlive entry
+     */
+    static void FillEntry(const json& data, LichessJson::LichessEntry& entry){
+        entry.Clear();
+        entry.fen = data.at("fen").get_ref<const std::string&>();
+
+        for(const json& eval : data.at("evals")) {
+            LichessJson::EvalEntry eval_entry;
+            eval_entry.depth = eval.at("depth");
+            eval_entry.first_pv = entry.pvs.size();
+
+            for(const json& pv : eval.at("pvs")) {
+                LichessJson::PvEntry pv_entry;
+                pv_entry.is_mate = pv.contains("mate");
+                pv_entry.score = pv_entry.is_mate ? pv.at("mate").get<int>() : pv.at("cp").get<int>();
+                pv_entry.line = pv.at("line").get_ref<const std::string&>();
+                entry.pvs.push_back(pv_entry);
+            }
+            eval_entry.pv_count = entry.pvs.size() - eval_entry.first_pv;
+            entry.evals.push_back(eval_entry);
+        }
+    }
 
-        SearchUtils::PlyData ply_data[2];
+    /**
+     * @brief replays every deep enough pv of a lichess eval, and adds the quiet positions along each pv to output
+     * @param board a board only used by this thread, as it is overwritten
+     */
+    inline void ReplayEntry(const LichessJson::LichessEntry& entry, Board& board, std::vector<DataPoint>& output){
+        SearchUtils::PlyData ply_data[2] = {};
 
-        for(const json& eval : data["evals"]) {
-            int depth = eval["depth"];
+        for(const LichessJson::EvalEntry& eval : entry.evals) {
+            int depth = eval.depth;
             if(depth < 8){continue;}//too low depth
 
-            for(const json& pv : eval["pvs"]) {
+            for(size_t pv_idx = eval.first_pv; pv_idx < eval.first_pv + eval.pv_count; pv_idx++) {
+                const LichessJson::PvEntry& pv = entry.pvs[pv_idx];
                 std::optional<float> opt_wanted_output = GetTanhScore(pv);//this score is only valid when the pv has been played, as it could be a second pv that is really terrible
                 if(!opt_wanted_output){
                     continue;//mate in {small number}, skip this one
                 }
                 float wanted_output = opt_wanted_output.value();
                 assert(std::abs(wanted_output) <= 1);
-                StringTools::ReadFEN(fen, board, ply_data);//reset board
+                StringTools::ReadFEN(entry.fen, board, ply_data);//reset board, reading straight from the input without a copy
 
-                std::string uci_moves = pv["line"];
-                std::istringstream uci_move_stream(uci_moves);
+                std::string_view uci_moves = pv.line;
 
-                std::string curr_move_str;
                 int curr_move_idx=-1;//increment to start at 0
-                while(uci_move_stream >> curr_move_str){
+                while(!uci_moves.empty()){
+                    const size_t move_end = std::min(uci_moves.find(' '), uci_moves.size());
+                    const std::string curr_move_str(uci_moves.substr(0, move_end));//short enough to not allocate
+                    uci_moves.remove_prefix(std::min(move_end + 1, uci_moves.size()));
+                    if(curr_move_str.empty()){
+                        continue;//repeated spaces
+                    }
+
                     Move move = StringTools::MoveFromString(ply_data, curr_move_str);
                     curr_move_idx++;
                     if(!MoveGenerator::VerifyMove(board, move) || move == MoveUtils::NULL_MOVE){
@@ -180,7 +203,7 @@ namespace QuietGen {
 
                     BoardUtils::MakeMove(board, move, ply_data);//play the move, so that the score becomes true
                     int piece_count = BitboardUtils::PopCount(board.colour_bitboard[0] | board.colour_bitboard[1]);
-                    const bool invalid_position_for_training = ply_data[0].in_check || !PieceUtils::IsEmpty(ply_data[0].killed) || piece_count <= 5;
+                    const bool invalid_position_for_training = MoveGenerator::InCheck(board) || !PieceUtils::IsEmpty(ply_data[0].killed) || piece_count <= 5;
                     ply_data[0] = ply_data[1];//shuffle along pretend-stack
 
                     if(invalid_position_for_training){
@@ -192,24 +215,201 @@ namespace QuietGen {
 
                     DataPoint data = DataPoint(board, wanted_output);
                     assert(std::abs(data.tanh_score) <= 1);
-                    if(!out_writer.CanWrite()){
-                        return false;//cannot write to file, stop here
+                    output.push_back(data);
+                }
+
+            }
+        }
+    }
+
+    /**
+     * @brief per thread buffers, kept between lines so that parsing doesn't allocate
+     */
+    struct ParseScratch{
+        LichessJson::LichessEntry entry;
+        LichessJson::LichessEntry validation_entry;
+        std::vector<DataPoint> validation_output;
+    };
+
+    /**
+     * @brief adds the training data from one line of the lichess dump to output
+     * @note a line that isn't valid json, or is missing a field, is counted in skipped_lines and adds nothing
+     */
+    inline void HandleJsonEntry(std::string_view json_data, Board& board, std::vector<DataPoint>& output, ParseMode mode, ParseScratch& scratch){
+        if(mode == ParseMode::STREAMING && LichessJson::Scanner(json_data).ParseLine(scratch.entry)){
+            ReplayEntry(scratch.entry, board, output);
+            return;
+        }
+
+        json data;
+        try{
+            data = json::parse(json_data);
+            FillEntry(data, scratch.entry);
+        } catch(const json::exception&){
+            skipped_lines++;//a throw here would take down every worker, so carry on with the next line
+            return;
+        }
+        const size_t output_start = output.size();
+        ReplayEntry(scratch.entry, board, output);
+
+        if(mode == ParseMode::VALIDATE){
+            scratch.validation_output.clear();
+            const bool scanned = LichessJson::Scanner(json_data).ParseLine(scratch.validation_entry);
+            if(scanned){
+                ReplayEntry(scratch.validation_entry, board, scratch.validation_output);
+            }
+
+            const size_t expected_bytes = (output.size() - output_start) * sizeof(DataPoint);
+            const bool identical = scanned && scratch.validation_output.size() == output.size() - output_start &&
+                std::memcmp(scratch.validation_output.data(), output.data() + output_start, expected_bytes) == 0;
+            if(!identical){
+                validation_mismatches++;
+                sync_cout << "streaming parser disagrees with nlohmann on: " << json_data << std::endl;
+            }
+        }
+    }
+
+    /**
+     * @brief splits text into chunks of about CHUNK_BYTES, each ending just after a newline
+     */
+    inline std::vector<std::string_view> SplitIntoChunks(std::string_view text){
+        std::vector<std::string_view> chunks;
+        while(!text.empty()){
+            size_t chunk_end = std::min(CHUNK_BYTES, text.size());
+            const size_t newline = text.find('\n', chunk_end - 1);
+            chunk_end = newline == std::string_view::npos ? text.size() : newline + 1;
+
+            chunks.push_back(text.substr(0, chunk_end));
+            text.remove_prefix(chunk_end);
+        }
+        return chunks;
+    }
+
+    /**
+     * @brief converts every line of input to training data, with thread_count workers that each own a board claiming chunks of the input, and this thread writing to out
+     * @returns the number of lines read
+     */
+    inline size_t RunPipeline(std::string_view input, ShufflingBufferedWriter& out, unsigned thread_count, ParseMode mode = ParseMode::STREAMING){
+        thread_count = std::max(thread_count, 1u);
+        const std::vector<std::string_view> chunks = SplitIntoChunks(input);
+        BlockingQueue<std::vector<DataPoint>> output_batches(thread_count * BATCHES_PER_THREAD);
+        std::atomic<size_t> next_chunk = 0;
+        std::atomic<size_t> lines_read = 0;
+        std::atomic<size_t> bytes_read = 0;
+        std::atomic<unsigned> running_workers = thread_count;
+
+        std::vector<std::thread> workers;
+        for(unsigned i=0;i<thread_count;i++){
+            workers.emplace_back([&]{
+                Board board;//each worker replays pvs on its own board
+                ParseScratch scratch;
+                std::vector<DataPoint> data_points;
+                size_t lines_in_batch = 0;
+
+                for(size_t chunk_idx = next_chunk++; chunk_idx < chunks.size() && !CommandLine::stop_requested.load(std::memory_order_relaxed); chunk_idx = next_chunk++){
+                    std::string_view chunk = chunks[chunk_idx];
+                    while(!chunk.empty()){
+                        const size_t line_end = std::min(chunk.find('\n'), chunk.size());
+                        const std::string_view line = chunk.substr(0, line_end);
+                        chunk.remove_prefix(std::min(line_end + 1, chunk.size()));
+                        if(line.empty()){
+                            continue;
+                        }
+
+                        HandleJsonEntry(line, board, data_points, mode, scratch);
+                        lines_read.fetch_add(1, std::memory_order_relaxed);
+                        if(++lines_in_batch == LINES_PER_BATCH){
+                            output_batches.Push(std::move(data_points));
+                            data_points = {};
+                            lines_in_batch = 0;
+                        }
                     }
-                    out_writer.SaveEntry(data);
+                    bytes_read.fetch_add(chunks[chunk_idx].size(), std::memory_order_relaxed);
                 }
 
+                output_batches.Push(std::move(data_points));
+                if(--running_workers == 0){
+                    output_batches.Close();//the last worker to finish lets the writer stop
+                }
+            });
+        }
+
+        //the writer isn't thread-safe, so only this thread saves entries
+        TimePoint start_time = TimePoint();
+        TimePoint next_report(PROGRESS_INTERVAL_MS);
+        while(std::optional<std::vector<DataPoint>> batch = output_batches.Pop()){
+            if(!out.CanWrite()){
+                continue;//keep draining so that the workers can finish
             }
+            for(const DataPoint& dp : batch.value()){
+                out.SaveEntry(dp);
+            }
+
+            if(next_report.NowIsPastTimePoint()){
+                next_report = TimePoint(PROGRESS_INTERVAL_MS);
+                const uint64_t elapsed_ms = std::max<uint64_t>(start_time.HowLongAgo(), 1);
+                sync_cout << std::fixed << std::setprecision(1) <<
+                100.0 * bytes_read.load() / std::max<size_t>(input.size(), 1) << "% " <<
+                lines_read.load() << " lines " <<
+                out.EntriesSaved() << " positions " <<
+                out.EntriesSaved() * 1000 / elapsed_ms << " positions/s" << std::endl;
+            }
+        }
+
+        for(std::thread& worker : workers){
+            worker.join();
         }
-        return true;
+        return lines_read.load();
     }
 
-    void signalHandler(int signal) {
-        if (signal == SIGINT) {
-            std::cout << "\nCtrl+C detected. Exiting gracefully...\n";
-            out_writer.Destruct();//prevent writing to file while I close it
-            in_file.close();
+    /**
+     * @brief settings from the command line
+     */
+    struct Config{
+        std::string input_path;
+        std::string output_path = "nn_training_data.bin";
+        size_t buffer_elements = DEFAULT_BUFFER_ELEMENTS;//how many positions are shuffled together before being written
+        unsigned thread_count = std::thread::hardware_concurrency();
+        ParseMode parse_mode = ParseMode::STREAMING;
+
+        std::string shuffle_path;//when set, globally shuffles and dedups this training data file instead of reading the lichess dump
+        uint64_t seed = 0;
+
+        std::string pack_path;//when set, converts this training data file to the packed format
+        std::string unpack_path;//when set, converts this packed file back to data points
+    };
+
+    const std::string USAGE = "usage: main --input <lichess_evals.json> [--output <file>] [--buffer <positions>] [--threads <count>] [--parser streaming|nlohmann|validate] [--seed <number>]\n"
+        "   or: main --shuffle <training data> [--output <file>] [--buffer <positions>] [--seed <number>]\n"
+        "   or: main --pack <training data> [--output <file>]\n"
+        "   or: main --unpack <packed training data> [--output <file>]";
+
+    const std::vector<CommandLine::Flag<Config>> FLAGS = {
+        {"--input",   [](Config& config, const std::string& value){ config.input_path = value; }},
+        {"--output",  [](Config& config, const std::string& value){ config.output_path = value; }},
+        {"--buffer",  [](Config& config, const std::string& value){ config.buffer_elements = std::max<size_t>(std::stoull(value), 1); }},
+        {"--threads", [](Config& config, const std::string& value){ config.thread_count = std::max(std::stoi(value), 1); }},
+        {"--parser",  [](Config& config, const std::string& value){ config.parse_mode = ParseParseMode(value); }},
+        {"--seed",    [](Config& config, const std::string& value){ config.seed = std::stoull(value); }},
+        {"--shuffle", [](Config& config, const std::string& value){ config.shuffle_path = value; }},
+        {"--pack",    [](Config& config, const std::string& value){ config.pack_path = value; }},
+        {"--unpack",  [](Config& config, const std::string& value){ config.unpack_path = value; }},
+    };
+
+    /**
+     * @returns the settings, or nullopt (after printing why) if the arguments are wrong
+     */
+    inline std::optional<Config> ParseArguments(int argc, char** argv){
+        Config config;
+        if(!CommandLine::ParseFlags(argc, argv, FLAGS, USAGE, config)){
+            return std::nullopt;
+        }
 
-            std::exit(0); // Exit the program
+        const int modes_chosen = !config.input_path.empty() + !config.shuffle_path.empty() + !config.pack_path.empty() + !config.unpack_path.empty();
+        if(modes_chosen != 1){
+            sync_cout << USAGE << std::endl;
+            return std::nullopt;
         }
+        return config;
     }
-};
\ No newline at end of file
+};
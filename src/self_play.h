@@ -0,0 +1,260 @@
+#pragma once
+
+#include "Board.h"
+#include "Engine.h"
+#include "MoveGenerator.h"
+#include "StringTools.h"
+#include "Bitbase.h"
+#include "Timer.h"
+#include "threadsafe_io.h"
+#include "command_line.h"
+#include "training_data.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief plays the engine against itself to make training data, with every thread playing its own games on its own worker
+ * @note every game is seeded from the game number, and searches are limited by nodes or depth rather than time, so a run can be repeated exactly
+ */
+namespace SelfPlay {
+
+const std::string START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+constexpr int MAX_GAME_PLIES = 400;//games this long are called a draw, well within BoardUtils::MAX_GAME_LENGTH
+constexpr Evaluation RESIGN_SCORE = 1000;//a side resigns after scoring this badly for RESIGN_PLIES plies in a row
+constexpr int RESIGN_PLIES = 6;
+constexpr int MIN_TRAINING_PIECES = 6;//same as the lichess data, as the bitbases cover smaller endings
+constexpr uint64_t PROGRESS_INTERVAL_MS = 5000;
+
+/**
+ * @brief settings from the command line
+ */
+struct Config{
+    std::string output_path = "self_play_data.bin";
+    size_t games = 1000;
+    unsigned thread_count = std::thread::hardware_concurrency();
+    int depth = 0;//when not 0, searches stop at this depth instead of using nodes
+    uint64_t nodes = 5000;
+    int random_plies = 8;//random moves played at the start of each game, so that the games differ
+    int hash_mb = 4;//per thread
+    int result_weight = 50;//percentage of each target that comes from the game result, with the rest from the search score
+    size_t buffer_elements = QuietGen::DEFAULT_BUFFER_ELEMENTS;
+    uint64_t seed = 0;
+};
+
+const std::string USAGE = "usage: main [--output <file>] [--games <count>] [--threads <count>] [--nodes <count> | --depth <ply>] "
+    "[--random-plies <count>] [--hash <MB per thread>] [--result-weight <percent>] [--buffer <positions>] [--seed <number>]";
+
+const std::vector<CommandLine::Flag<Config>> FLAGS = {
+    {"--output",        [](Config& config, const std::string& value){ config.output_path = value; }},
+    {"--games",         [](Config& config, const std::string& value){ config.games = std::stoull(value); }},
+    {"--threads",       [](Config& config, const std::string& value){ config.thread_count = std::max(std::stoi(value), 1); }},
+    {"--nodes",         [](Config& config, const std::string& value){ config.nodes = std::max<uint64_t>(std::stoull(value), 1); config.depth = 0; }},
+    {"--depth",         [](Config& config, const std::string& value){ config.depth = std::clamp(std::stoi(value), 2, Engine::MAX_SEARCH_DEPTH); }},
+    {"--random-plies",  [](Config& config, const std::string& value){ config.random_plies = std::max(std::stoi(value), 0); }},
+    {"--hash",          [](Config& config, const std::string& value){ config.hash_mb = std::max(std::stoi(value), 1); }},
+    {"--result-weight", [](Config& config, const std::string& value){ config.result_weight = std::clamp(std::stoi(value), 0, 100); }},
+    {"--buffer",        [](Config& config, const std::string& value){ config.buffer_elements = std::max<size_t>(std::stoull(value), 1); }},
+    {"--seed",          [](Config& config, const std::string& value){ config.seed = std::stoull(value); }},
+};
+
+/**
+ * @returns the settings, or nullopt (after printing why) if the arguments are wrong
+ */
+inline std::optional<Config> ParseArguments(int argc, char** argv){
+    Config config;
+    if(!CommandLine::ParseFlags(argc, argv, FLAGS, USAGE, config)){
+        return std::nullopt;
+    }
+    return config;
+}
+
+/**
+ * @brief totals across every game, updated as each game finishes
+ */
+struct Totals{
+    std::atomic<size_t> games_played = 0;
+    std::atomic<size_t> white_wins = 0;
+    std::atomic<size_t> draws = 0;
+    std::atomic<size_t> black_wins = 0;
+    std::atomic<size_t> positions = 0;
+};
+
+/**
+ * @returns true if neither side has enough pieces to mate
+ */
+inline bool InsufficientMaterial(const Board& board){
+    const Bitboard heavy_pieces = board.piece_bitboard[PieceUtils::PAWN] | board.piece_bitboard[PieceUtils::ROOK] | board.piece_bitboard[PieceUtils::QUEEN];
+    const Bitboard minor_pieces = board.piece_bitboard[PieceUtils::KNIGHT] | board.piece_bitboard[PieceUtils::BISHOP];
+    return heavy_pieces == 0 && BitboardUtils::PopCount(minor_pieces) <= 1;
+}
+
+/**
+ * @brief generates the legal moves of the worker's current position, which also sets whether it is in check
+ * @returns the end of the move list
+ */
+inline Move* GenerateLegalMoves(Worker& w, Move* move_list){
+    return w.current_board.turn ?
+        MoveGenerator::GenerateMain<true, MoveGenerator::ALL_MOVES>(w.current_board, w.current_ply_before_search, move_list) :
+        MoveGenerator::GenerateMain<false, MoveGenerator::ALL_MOVES>(w.current_board, w.current_ply_before_search, move_list);
+}
+
+/**
+ * @brief plays a move on the worker's game, like a "position ... moves" command
+ */
+inline void PlayMove(Worker& w, Move move){
+    w.repetition_table.Push(w.current_ply_before_search->zobrist);
+    BoardUtils::MakeMove(w.current_board, move, w.current_ply_before_search);
+    w.current_ply_before_search++;
+}
+
+/**
+ * @brief plays one game, adding its quiet positions to output
+ * @returns the result from white's point of view: 1 for a win, 0 for a draw, -1 for a loss
+ */
+inline int PlayGame(Worker& w, std::mt19937_64& rng, const Config& config, std::vector<QuietGen::DataPoint>& output){
+    struct PendingPosition{
+        QuietGen::DataPoint data_point;
+        float search_target;//tanh of the search score, from white's point of view
+    };
+    std::vector<PendingPosition> pending;
+    Move move_list[MoveGenerator::MAX_MOVE_COUNT];
+
+    //random opening, which starts again if it walks into the end of the game
+    bool opening_done = false;
+    while(!opening_done){
+        std::fill(std::begin(w.current_board_search_stack), std::end(w.current_board_search_stack), SearchUtils::PlyData());//killer moves from earlier games are kept in the stack
+        w.current_ply_before_search = w.current_board_search_stack;
+        w.repetition_table.Clear();
+        StringTools::ReadFEN(START_FEN, w.current_board, w.current_ply_before_search);
+
+        opening_done = true;
+        for(int ply=0;ply<config.random_plies;ply++){
+            Move* end = GenerateLegalMoves(w, move_list);
+            if(end == move_list){
+                opening_done = false;
+                break;
+            }
+            PlayMove(w, move_list[std::uniform_int_distribution<size_t>(0, end - move_list - 1)(rng)]);
+        }
+    }
+    //forget everything from earlier games, so that a game plays the same whichever thread it is on
+    w.transposition_table.ClearTable();
+    w.leaf_nodes_searched = 0;//the node limit is only checked every 2048 nodes in total
+
+    int result = 0;
+    int resign_count = 0;
+    for(int ply=config.random_plies; ply<MAX_GAME_PLIES; ply++){
+        SearchUtils::PlyData* ply_data = w.current_ply_before_search;
+        const bool white_to_move = w.current_board.turn;
+
+        if(GenerateLegalMoves(w, move_list) == move_list){
+            result = ply_data->in_check ? (white_to_move ? -1 : 1) : 0;//checkmate or stalemate
+            break;
+        }
+        if(ply_data->fifty_move_rule >= 100 || w.repetition_table.IsRepetition(ply_data->zobrist, ply_data->fifty_move_rule) || InsufficientMaterial(w.current_board)){
+            break;
+        }
+        const bool in_check = ply_data->in_check;
+
+        w.stop_condition.store(false);
+        Engine::StartSearch(w, config.depth ? config.depth : Engine::MAX_SEARCH_DEPTH, UINT32_MAX, 0, config.depth ? 0 : config.nodes);
+        const SearchResult search = w.last_result;
+        if(search.best_move == MoveUtils::NULL_MOVE){
+            break;//the search didn't finish an iteration, so the game can't go on
+        }
+        if(search.score == Eval::NULL_EVAL){
+            PlayMove(w, search.best_move);//forced move, which has no score to learn from
+            continue;
+        }
+        const Evaluation white_score = white_to_move ? search.score : -search.score;
+
+        const bool last_move_was_capture = ply_data != w.current_board_search_stack && !PieceUtils::IsEmpty((ply_data - 1)->killed);
+        const bool best_move_is_quiet = PieceUtils::IsEmpty(w.current_board.squares[MoveUtils::ToSquare(search.best_move)]) && PieceUtils::IsEmpty(MoveUtils::PromotionBase(search.best_move));
+        const int piece_count = BitboardUtils::PopCount(w.current_board.colour_bitboard[0] | w.current_board.colour_bitboard[1]);
+        if(!in_check && !last_move_was_capture && best_move_is_quiet && piece_count >= MIN_TRAINING_PIECES && std::abs(search.score) < Eval::FURTHEST_MATE){
+            pending.push_back({QuietGen::DataPoint(w.current_board, 0), std::tanh(white_score / 200.0f)});//same scaling as the lichess data
+        }
+
+        resign_count = std::abs(search.score) >= RESIGN_SCORE ? resign_count + 1 : 0;
+        if(resign_count >= RESIGN_PLIES){
+            result = white_score > 0 ? 1 : -1;
+            break;
+        }
+
+        PlayMove(w, search.best_move);
+    }
+
+    const float result_weight = config.result_weight / 100.0f;
+    for(PendingPosition& position : pending){
+        position.data_point.tanh_score = (1 - result_weight) * position.search_target + result_weight * result;
+        output.push_back(position.data_point);
+    }
+    return result;
+}
+
+/**
+ * @brief plays config.games games across config.thread_count threads, saving the positions to out
+ */
+inline void Run(const Config& config, QuietGen::ShufflingBufferedWriter& out, Totals& totals){
+    const unsigned thread_count = std::max(config.thread_count, 1u);
+    std::atomic<size_t> next_game = 0;
+    std::atomic<unsigned> running_threads = thread_count;
+    std::mutex out_mutex;
+
+    std::vector<std::thread> threads;
+    for(unsigned i=0;i<thread_count;i++){
+        threads.emplace_back([&]{
+            std::atomic<bool> stop_flag = true;
+            std::unique_ptr<Worker> worker = std::make_unique<Worker>(stop_flag, config.hash_mb);
+            worker->print_info = false;
+            std::vector<QuietGen::DataPoint> positions;
+
+            for(size_t game = next_game++; game < config.games && !CommandLine::stop_requested.load(std::memory_order_relaxed); game = next_game++){
+                std::seed_seq game_seed{config.seed, (uint64_t)game};
+                std::mt19937_64 rng(game_seed);
+
+                positions.clear();
+                const int result = PlayGame(*worker, rng, config, positions);
+                {
+                    std::lock_guard lock(out_mutex);//the writer isn't thread-safe
+                    for(const QuietGen::DataPoint& dp : positions){
+                        out.SaveEntry(dp);
+                    }
+                }
+
+                totals.positions += positions.size();
+                (result > 0 ? totals.white_wins : result < 0 ? totals.black_wins : totals.draws)++;
+                totals.games_played++;
+            }
+            running_threads--;
+        });
+    }
+
+    TimePoint next_report(PROGRESS_INTERVAL_MS);
+    while(running_threads.load() > 0){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if(!next_report.NowIsPastTimePoint()){
+            continue;
+        }
+        next_report = TimePoint(PROGRESS_INTERVAL_MS);
+        sync_cout << totals.games_played.load() << "/" << config.games << " games " <<
+        "+" << totals.white_wins.load() << " =" << totals.draws.load() << " -" << totals.black_wins.load() << " " <<
+        totals.positions.load() << " positions" << std::endl;
+    }
+
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+}
+
+} // namespace SelfPlay
@@ -0,0 +1,420 @@
+#pragma once
+
+#include "Board.h"
+#include "Engine.h"
+#include "MoveGenerator.h"
+#include "StringTools.h"
+#include "threadsafe_io.h"
+#include "command_line.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief runs tactical EPD suites (bm and am opcodes) to measure how quickly the search finds the right move
+ * @note a position counts as solved once the correct move is the best move of every iteration until the search ends,
+ * and the time and nodes to solve are those of the first iteration in that run
+ */
+namespace TestSuite {
+
+constexpr uint64_t DEFAULT_MOVETIME_MS = 1000;
+
+/**
+ * @brief settings from the command line
+ */
+struct Config{
+    std::string input_path;
+    unsigned thread_count = 1;//more threads finish a suite sooner, but make the times less comparable
+    int hash_mb = 64;//per thread
+    int depth = 0;
+    uint64_t nodes = 0;
+    uint64_t movetime_ms = 0;
+};
+
+const std::string USAGE = "usage: main --suite <epd file> [--threads <count>] [--hash <MB per thread>] [--depth <ply> | --nodes <count> | --movetime <ms>]";
+
+const std::vector<CommandLine::Flag<Config>> FLAGS = {
+    {"--suite",    [](Config& config, const std::string& value){ config.input_path = value; }},
+    {"--threads",  [](Config& config, const std::string& value){ config.thread_count = std::max(std::stoi(value), 1); }},
+    {"--hash",     [](Config& config, const std::string& value){ config.hash_mb = std::max(std::stoi(value), 1); }},
+    {"--depth",    [](Config& config, const std::string& value){ config.depth = std::clamp(std::stoi(value), 1, Engine::MAX_SEARCH_DEPTH); }},
+    {"--nodes",    [](Config& config, const std::string& value){ config.nodes = std::max<uint64_t>(std::stoull(value), 1); }},
+    {"--movetime", [](Config& config, const std::string& value){ config.movetime_ms = std::max<uint64_t>(std::stoull(value), 1); }},
+};
+
+/**
+ * @returns the settings, or nullopt (after printing why) if the arguments are wrong
+ */
+inline std::optional<Config> ParseArguments(int argc, char** argv){
+    Config config;
+    if(!CommandLine::ParseFlags(argc, argv, FLAGS, USAGE, config)){
+        return std::nullopt;
+    }
+
+    if(config.input_path.empty()){
+        sync_cout << USAGE << std::endl;
+        return std::nullopt;
+    }
+    if((config.depth != 0) + (config.nodes != 0) + (config.movetime_ms != 0) > 1){
+        sync_cout << "only one of --depth, --nodes and --movetime can be used" << std::endl;
+        return std::nullopt;
+    }
+    if(config.depth == 0 && config.nodes == 0 && config.movetime_ms == 0){
+        config.movetime_ms = DEFAULT_MOVETIME_MS;
+    }
+    return config;
+}
+
+/**
+ * @brief a position from the suite, with its bm and am moves found among the legal moves
+ */
+struct SuitePosition{
+    std::string fen;
+    std::string id;//the id opcode, or the line number if there isn't one
+    std::vector<Move> best_moves;
+    std::vector<Move> avoid_moves;
+    std::string expected;//the bm and am opcodes as written, for the report
+};
+
+/**
+ * @brief converts a legal move to standard algebraic notation, without the + or # suffix
+ * @param legal_moves every legal move in the position, which is needed to tell pieces apart
+ */
+inline std::string MoveToSAN(const Board& board, Move m, const std::vector<Move>& legal_moves){
+    const Square from = MoveUtils::FromSquare(m);
+    const Square to = MoveUtils::ToSquare(m);
+    const Piece piece = board.squares[from];
+    const Piece base_piece = PieceUtils::BasePiece(piece);
+    const bool changes_file = SquareUtils::ToFile(from) != SquareUtils::ToFile(to);
+
+    if(base_piece == PieceUtils::KING && std::abs((int)SquareUtils::ToFile(from) - (int)SquareUtils::ToFile(to)) == 2){
+        return SquareUtils::ToFile(to) > SquareUtils::ToFile(from) ? "O-O" : "O-O-O";
+    }
+
+    const bool is_capture = !PieceUtils::IsEmpty(board.squares[to]) || (base_piece == PieceUtils::PAWN && changes_file);//a pawn only changes file when capturing, including en passant
+    std::string san;
+    if(base_piece == PieceUtils::PAWN){
+        if(is_capture){
+            san += StringTools::SquareToString(from)[0];
+        }
+    } else {
+        san += (char)std::toupper(StringTools::ToLetter(base_piece)[0]);
+
+        //name the file, rank or both if another piece of the same type can also move to this square
+        bool ambiguous = false, same_file = false, same_rank = false;
+        for(Move other : legal_moves){
+            const Square other_from = MoveUtils::FromSquare(other);
+            if(other_from != from && MoveUtils::ToSquare(other) == to && board.squares[other_from] == piece){
+                ambiguous = true;
+                same_file |= SquareUtils::ToFile(other_from) == SquareUtils::ToFile(from);
+                same_rank |= SquareUtils::ToRank(other_from) == SquareUtils::ToRank(from);
+            }
+        }
+        const std::string from_text = StringTools::SquareToString(from);
+        if(ambiguous && (!same_file || same_rank)){
+            san += from_text[0];
+        }
+        if(ambiguous && same_file){
+            san += from_text[1];
+        }
+    }
+
+    if(is_capture){
+        san += 'x';
+    }
+    san += StringTools::SquareToString(to);
+    if(!PieceUtils::IsEmpty(MoveUtils::PromotionBase(m))){
+        san += '=';
+        san += (char)std::toupper(StringTools::ToLetter(MoveUtils::PromotionBase(m))[0]);
+    }
+    return san;
+}
+
+/**
+ * @returns every legal move of the position, which also sets whether it is in check
+ */
+inline std::vector<Move> LegalMoves(Board& board, SearchUtils::PlyData* ply_data){
+    Move move_list[MoveGenerator::MAX_MOVE_COUNT];
+    Move* end = board.turn ?
+        MoveGenerator::GenerateMain<true, MoveGenerator::ALL_MOVES>(board, ply_data, move_list) :
+        MoveGenerator::GenerateMain<false, MoveGenerator::ALL_MOVES>(board, ply_data, move_list);
+    return std::vector<Move>(move_list, end);
+}
+
+/**
+ * @brief removes check marks and annotations, and writes castling with letters, so that suites written in different styles match
+ */
+inline std::string NormaliseMoveText(std::string text){
+    while(!text.empty() && (text.back() == '+' || text.back() == '#' || text.back() == '!' || text.back() == '?')){
+        text.pop_back();
+    }
+    std::replace(text.begin(), text.end(), '0', 'O');
+    return text;
+}
+
+/**
+ * @brief splits the opcodes of an EPD line into their names and operands, keeping quoted operands together
+ */
+inline std::vector<std::pair<std::string, std::string>> ParseOpcodes(const std::string& opcodes){
+    std::vector<std::pair<std::string, std::string>> result;
+    std::string current;
+    bool in_quotes = false;
+    auto finish = [&]{
+        std::istringstream fields(current);
+        std::string name, operands;
+        if(fields >> name){
+            std::getline(fields, operands);
+            operands.erase(0, operands.find_first_not_of(' '));
+            result.emplace_back(name, operands);
+        }
+        current.clear();
+    };
+    for(char c : opcodes){
+        if(c == '"'){
+            in_quotes = !in_quotes;
+        } else if(c == ';' && !in_quotes){
+            finish();
+        } else {
+            current += c;
+        }
+    }
+    finish();
+    return result;
+}
+
+/**
+ * @brief reads the positions that have a bm or am opcode
+ * @note moves can be in SAN or UCI notation. positions with a move that isn't legal are reported and left out
+ */
+inline std::vector<SuitePosition> LoadSuite(const std::string& path){
+    std::vector<SuitePosition> positions;
+    std::ifstream file(path);
+    Board board;
+    SearchUtils::PlyData ply_data = {};
+    std::string line;
+    for(size_t line_number = 1; std::getline(file, line); line_number++){
+        std::istringstream fields(line);
+        std::string placement, turn, castling, enpassant;
+        if(!(fields >> placement >> turn >> castling >> enpassant) || (turn != "w" && turn != "b")){
+            continue;
+        }
+        std::string opcodes;
+        std::getline(fields, opcodes);
+
+        SuitePosition position;
+        position.fen = placement + " " + turn + " " + castling + " " + enpassant + " 0 1";
+        position.id = std::to_string(line_number);
+        StringTools::ReadFEN(position.fen, board, &ply_data);
+        const std::vector<Move> legal_moves = LegalMoves(board, &ply_data);
+
+        const std::vector<std::pair<std::string, std::string>> parsed_opcodes = ParseOpcodes(opcodes);
+        for(const auto& [name, operands] : parsed_opcodes){
+            if(name == "id"){
+                position.id = operands;//read first, so that skipped positions can be named
+            }
+        }
+
+        bool all_moves_found = true;
+        for(const auto& [name, operands] : parsed_opcodes){
+            if(name != "bm" && name != "am"){
+                continue;
+            }
+            if(!position.expected.empty()){
+                position.expected += "; ";
+            }
+            position.expected += name + " " + operands;
+            std::istringstream move_texts(operands);
+            std::string move_text;
+            while(move_texts >> move_text){
+                const std::string wanted = NormaliseMoveText(move_text);
+                const auto found = std::find_if(legal_moves.begin(), legal_moves.end(), [&](Move m){
+                    return MoveToSAN(board, m, legal_moves) == wanted || StringTools::MoveToString(m) == move_text;
+                });
+                if(found == legal_moves.end()){
+                    all_moves_found = false;
+                    sync_cout << "skipping " << position.id << ": " << move_text << " is not a legal move" << std::endl;
+                    break;
+                }
+                (name == "bm" ? position.best_moves : position.avoid_moves).push_back(*found);
+            }
+        }
+        if(all_moves_found && (!position.best_moves.empty() || !position.avoid_moves.empty())){
+            positions.push_back(position);
+        }
+    }
+    return positions;
+}
+
+/**
+ * @returns true if playing m would pass the position's bm and am opcodes
+ */
+inline bool IsCorrect(const SuitePosition& position, Move m){
+    const auto contains = [&](const std::vector<Move>& moves){return std::find(moves.begin(), moves.end(), m) != moves.end();};
+    return m != MoveUtils::NULL_MOVE && (position.best_moves.empty() || contains(position.best_moves)) && !contains(position.avoid_moves);
+}
+
+/**
+ * @brief how the search did on one position
+ */
+struct SolveResult{
+    bool solved = false;
+    int first_seen_depth = 0;//the first iteration that had a correct move, even if it changed its mind later. 0 if it never did
+    int solved_depth = 0;//the first iteration of the run of correct moves that lasted to the end of the search
+    uint64_t solve_time_ms = 0;
+    uint64_t solve_nodes = 0;
+    Move played = MoveUtils::NULL_MOVE;
+};
+
+/**
+ * @brief searches one position, recording every iteration to find when the correct move settled
+ */
+inline SolveResult Solve(Worker& w, const SuitePosition& position, const Config& config){
+    std::fill(std::begin(w.current_board_search_stack), std::end(w.current_board_search_stack), SearchUtils::PlyData());//killer moves from earlier positions are kept in the stack
+    w.current_ply_before_search = w.current_board_search_stack;
+    w.repetition_table.Clear();
+    StringTools::ReadFEN(position.fen, w.current_board, w.current_ply_before_search);
+    w.transposition_table.ClearTable();
+    w.leaf_nodes_searched = 0;//the node limit is only checked every 2048 nodes in total
+
+    w.stop_condition.store(false);
+    Engine::StartSearch(w, config.depth ? config.depth : Engine::MAX_SEARCH_DEPTH, config.movetime_ms ? config.movetime_ms : UINT32_MAX, 0, config.nodes);
+
+    SolveResult result;
+    result.played = w.last_result.best_move;
+    result.solved = IsCorrect(position, result.played);
+    for(const SearchResult& iteration : w.iteration_results){
+        if(IsCorrect(position, iteration.best_move) && result.first_seen_depth == 0){
+            result.first_seen_depth = iteration.depth;
+        }
+    }
+    if(!result.solved){
+        return result;
+    }
+
+    //the move played can come from an iteration that was stopped part way through, which counts as the end of the search
+    result.solved_depth = w.last_result.depth + 1;
+    result.solve_time_ms = w.last_result.time_ms;
+    result.solve_nodes = w.last_result.nodes;
+    for(auto it = w.iteration_results.rbegin(); it != w.iteration_results.rend() && IsCorrect(position, it->best_move); ++it){
+        result.solved_depth = it->depth;
+        result.solve_time_ms = it->time_ms;
+        result.solve_nodes = it->nodes;
+    }
+    if(result.first_seen_depth == 0){
+        result.first_seen_depth = result.solved_depth;
+    }
+    return result;
+}
+
+/**
+ * @brief searches every position across config.thread_count threads, printing each result as it finishes
+ * @returns the results, in the same order as positions. positions skipped after ctrl+c are left unsolved
+ */
+inline std::vector<SolveResult> Run(const std::vector<SuitePosition>& positions, const Config& config){
+    std::vector<SolveResult> results(positions.size());
+    std::atomic<size_t> next_position = 0;
+    std::atomic<size_t> solved_count = 0;
+    std::atomic<size_t> finished_count = 0;
+
+    std::vector<std::thread> threads;
+    for(unsigned t=0;t<config.thread_count;t++){
+        threads.emplace_back([&]{
+            std::atomic<bool> stop_flag = true;
+            std::unique_ptr<Worker> worker = std::make_unique<Worker>(stop_flag, config.hash_mb);
+            worker->print_info = false;
+            worker->record_iterations = true;
+
+            for(size_t i = next_position++; i < positions.size() && !CommandLine::stop_requested.load(std::memory_order_relaxed); i = next_position++){
+                const SolveResult result = Solve(*worker, positions[i], config);
+                results[i] = result;
+                solved_count += result.solved;
+                finished_count++;
+
+                std::ostringstream line;
+                line << "[" << finished_count.load() << "/" << positions.size() << "] " << positions[i].id << ": ";
+                if(result.solved){
+                    line << "solved at depth " << result.solved_depth << " (first seen at depth " << result.first_seen_depth << ") in " <<
+                    result.solve_time_ms << " ms, " << result.solve_nodes << " nodes";
+                } else {
+                    //the search leaves the worker on the suite position, so the played move can be named
+                    const std::string played = result.played == MoveUtils::NULL_MOVE ? "nothing" :
+                        MoveToSAN(worker->current_board, result.played, LegalMoves(worker->current_board, worker->current_ply_before_search));
+                    line << "failed, played " << played << " but expected " << positions[i].expected;
+                }
+                sync_cout << line.str() << std::endl;
+            }
+        });
+    }
+
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    return results;
+}
+
+/**
+ * @returns the value that fraction of the sorted values are below
+ */
+inline uint64_t Percentile(const std::vector<uint64_t>& sorted_values, double fraction){
+    return sorted_values[(size_t)(fraction * (sorted_values.size() - 1))];
+}
+
+/**
+ * @brief prints the min, quartiles, 90th percentile and max of a distribution, then how many were solved within each power of 10
+ */
+inline void PrintDistribution(const std::string& name, const std::string& unit, std::vector<uint64_t> values, size_t total_positions){
+    if(values.empty()){
+        return;
+    }
+    std::ranges::sort(values);
+    sync_cout << name << " to solve: min " << values.front() << " " << unit <<
+    ", 25% " << Percentile(values, 0.25) <<
+    ", median " << Percentile(values, 0.5) <<
+    ", 75% " << Percentile(values, 0.75) <<
+    ", 90% " << Percentile(values, 0.9) <<
+    ", max " << values.back() << std::endl;
+
+    std::ostringstream within;
+    within << "solved within";
+    uint64_t first_limit = 1;
+    while(first_limit * 10 <= values.front()){
+        first_limit *= 10;
+    }
+    for(uint64_t limit = first_limit; ; limit *= 10){
+        const size_t count = std::upper_bound(values.begin(), values.end(), limit) - values.begin();
+        within << " " << limit << " " << unit << ": " << count << "/" << total_positions << ",";
+        if(count == values.size()){
+            break;
+        }
+    }
+    std::string text = within.str();
+    text.pop_back();
+    sync_cout << text << std::endl;
+}
+
+/**
+ * @brief prints the solved count and the time and node distributions of the solved positions
+ */
+inline void PrintSummary(const std::vector<SolveResult>& results){
+    std::vector<uint64_t> times, nodes;
+    for(const SolveResult& result : results){
+        if(result.solved){
+            times.push_back(result.solve_time_ms);
+            nodes.push_back(result.solve_nodes);
+        }
+    }
+    sync_cout << "solved " << times.size() << "/" << results.size() << " (" << std::fixed << std::setprecision(1) <<
+    100.0 * times.size() / std::max<size_t>(results.size(), 1) << "%)" << std::endl;
+    PrintDistribution("time", "ms", times, results.size());
+    PrintDistribution("nodes", "nodes", nodes, results.size());
+}
+
+} // namespace TestSuite
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Board.h"
+#include "Engine.h"
+#include "Polyglot.h"
+#include "quiet_gen.h"
+#include "StringTools.h"
+#include "threadsafe_io.h"
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief regression checks for the engine, run by the test build. each check prints a line saying whether it passed
+ */
+namespace Tests {
+
+int failures = 0;
+
+inline void Check(bool passed, const std::string& name){
+    sync_cout << (passed ? "passed " : "FAILED ") << name << std::endl;
+    failures += !passed;
+}
+
+/**
+ * @brief searches fen to a fixed depth on a new worker, so that no history or transposition table entries are carried over from other checks
+ * @param nodes set to the number of nodes searched
+ */
+inline Evaluation SearchFresh(const std::string& fen, int depth, uint64_t& nodes){
+    std::atomic<bool> stop_flag = false;
+    std::unique_ptr<Worker> w = std::make_unique<Worker>(stop_flag, 16);
+    w->print_info = false;
+    w->current_ply_before_search = w->current_board_search_stack;
+    w->repetition_table.Clear();
+    StringTools::ReadFEN(fen, w->current_board, w->current_ply_before_search);
+
+    const Evaluation score = w->FixedDepthScore(depth);
+    nodes = w->leaf_nodes_searched;
+    return score;
+}
+
+/**
+ * @brief the halfmove clock only decides how far back to look for repetitions, and there is nothing before the root to look at,
+ * so the search must not change with it. IID and the singular search used to see their own position as a repetition once the clock was 4 or more
+ */
+inline void RepetitionIgnoresHalfmoveClock(){
+    const std::string position = "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - ";
+    constexpr int depth = 9;
+
+    uint64_t nodes_without_clock, nodes_with_clock;
+    const Evaluation score_without_clock = SearchFresh(position + "0 10", depth, nodes_without_clock);
+    const Evaluation score_with_clock = SearchFresh(position + "20 10", depth, nodes_with_clock);
+
+    Check(score_with_clock == score_without_clock && nodes_with_clock == nodes_without_clock, "repetition detection ignores the halfmove clock at the root");
+}
+
+/**
+ * @brief every field ReadFEN splits out has to come back out of ToFEN, including extra spaces between fields in the input
+ */
+inline void FENRoundTrip(){
+    const std::string fens[] = {
+        "rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq c6 0 0",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b Kq - 37 0",
+        "8/8/8/4k3/8/8/4P3/4K3 w - - 99 0",
+    };
+    bool all_match = true;
+    for(const std::string& fen : fens){
+        SearchUtils::PlyData ply_data[2];
+        Board board;
+        StringTools::ReadFEN(" " + fen.substr(0, fen.find(' ')) + "  " + fen.substr(fen.find(' ') + 1), board, ply_data);
+        all_match &= StringTools::ToFEN(board, ply_data) == fen;
+    }
+    Check(all_match, "FEN round trips through ReadFEN and ToFEN");
+}
+
+/**
+ * @brief the key of each position must be the one published with the polyglot book format, or no book position can ever be found
+ */
+inline void PolyglotReferenceKeys(){
+    const std::pair<std::string, uint64_t> positions[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x463B96181691FC9CULL},
+        {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", 0x823C9B50FD114196ULL},
+        {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", 0x22A48B5A8E47FF78ULL},
+        {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", 0x00FDD303C946BDD9ULL},
+        {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", 0x3C8123EA7B067637ULL},
+        {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", 0x5C3F9B829B279560ULL},
+    };
+    bool all_match = true;
+    for(const auto& [fen, key] : positions){
+        SearchUtils::PlyData ply_data[2];
+        Board board;
+        StringTools::ReadFEN(fen, board, ply_data);
+        all_match &= Polyglot::CalculateKey(board, ply_data) == key;
+    }
+    Check(all_match, "polyglot keys match the published reference positions");
+}
+
+const std::string LICHESS_SAMPLE_PATH = "test_data/lichess_evals_sample.jsonl";
+
+/**
+ * @brief the streaming scanner must make exactly the same training data as nlohmann on every line of the sample, without falling back to nlohmann
+ */
+inline void StreamingJsonMatchesNlohmann(){
+    std::ifstream sample(LICHESS_SAMPLE_PATH);
+    Board board;
+    QuietGen::ParseScratch scratch;
+    LichessJson::LichessEntry scanned_entry;
+    std::vector<QuietGen::DataPoint> scanned, parsed;
+    size_t lines = 0;
+    size_t total_positions = 0;
+    bool all_match = true;
+
+    std::string line;
+    while(std::getline(sample, line)){
+        scanned.clear();
+        parsed.clear();
+        const bool scanner_understood = LichessJson::Scanner(line).ParseLine(scanned_entry);
+        QuietGen::ReplayEntry(scanned_entry, board, scanned);
+        QuietGen::HandleJsonEntry(line, board, parsed, QuietGen::ParseMode::NLOHMANN, scratch);
+
+        all_match &= scanner_understood && scanned.size() == parsed.size() &&
+            std::memcmp(scanned.data(), parsed.data(), scanned.size() * sizeof(QuietGen::DataPoint)) == 0;
+        lines++;
+        total_positions += parsed.size();
+    }
+    Check(lines > 0 && total_positions > 0 && all_match, "streaming json scanner matches nlohmann on " + LICHESS_SAMPLE_PATH);
+}
+
+/**
+ * @brief a line nlohmann can't parse would throw inside a worker thread and end the whole run, so it must be skipped instead
+ */
+inline void MalformedJsonIsSkipped(){
+    Board board;
+    QuietGen::ParseScratch scratch;
+    std::vector<QuietGen::DataPoint> output;
+    const size_t skipped_before = QuietGen::skipped_lines.load();
+
+    QuietGen::HandleJsonEntry(R"({"fen":"8/8/8/4k3/8/8/4P3/4K3 w - -","evals":[{"pvs":[)", board, output, QuietGen::ParseMode::NLOHMANN, scratch);
+    QuietGen::HandleJsonEntry(R"({"fen":"8/8/8/4k3/8/8/4P3/4K3 w - -"})", board, output, QuietGen::ParseMode::VALIDATE, scratch);
+
+    Check(output.empty() && QuietGen::skipped_lines.load() == skipped_before + 2, "malformed json lines are skipped");
+}
+
+/**
+ * @returns the number of failed checks
+ */
+inline int RunAll(){
+    RepetitionIgnoresHalfmoveClock();
+    PolyglotReferenceKeys();
+    FENRoundTrip();
+    StreamingJsonMatchesNlohmann();
+    MalformedJsonIsSkipped();
+
+    sync_cout << (failures ? std::to_string(failures) + " checks failed" : "all checks passed") << std::endl;
+    return failures;
+}
+
+} // namespace Tests
@@ -0,0 +1,357 @@
+#pragma once
+
+#include "Board.h"
+#include "Engine.h"
+#include "StringTools.h"
+#include "Timer.h"
+#include "threadsafe_io.h"
+#include "command_line.h"
+#include "training_data.h"
+#include "packed_position.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief texel style tuning of SearchParams: finds the values that make a shallow search best predict the results of labelled games
+ * @note the evaluation itself is the neural network, so the pruning margins and LMR constants used by the search above the quiescence leaves are what gets tuned.
+ * TunableParams is not read by the network, so tuning it would have no effect
+ */
+namespace TexelTuner {
+
+constexpr int DEFAULT_DEPTH = 4;//at depth 2 the margins hardly ever trigger, so the error does not change
+constexpr int WORKER_HASH_MB = 1;//the table is cleared for every position, so it is kept small
+constexpr int MAX_PASSES = 100;
+
+/**
+ * @brief one search constant to tune, with the range it is kept within
+ */
+struct TunedParam{
+    const char* name;//as in SearchParams, for the generated header
+    int SearchParams::* param;
+    int min_value;
+    int max_value;
+    int initial_step;
+};
+
+//modes and switches (internal_iterative_mode, qsearch_checks) are left out, as they aren't values that can be stepped
+const std::vector<TunedParam> TUNED_PARAMS = {
+    {"lmr_base", &SearchParams::lmr_base, 0, 300, 10},
+    {"lmr_divisor", &SearchParams::lmr_divisor, 50, 1000, 20},
+    {"lmr_history_divisor", &SearchParams::lmr_history_divisor, 1000, 100'000, 1000},
+    {"rfp_margin", &SearchParams::rfp_margin, 0, 1000, 10},
+    {"futility_margin", &SearchParams::futility_margin, 0, 1000, 10},
+    {"razor_margin", &SearchParams::razor_margin, 0, 2000, 25},
+    {"lmp_base", &SearchParams::lmp_base, 0, 100, 1},
+    {"singular_margin", &SearchParams::singular_margin, 0, 100, 1},
+    {"delta_margin", &SearchParams::delta_margin, 0, 2000, 25},
+};
+
+/**
+ * @brief a labelled position, in the packed training data layout to keep the whole set in memory
+ * @note castling and en passant rights are dropped, like most tuning sets
+ */
+#pragma pack(push,1)
+struct TuningPosition{
+    PackedPosition::PackedDataPoint position;//the score holds the game result for white: -1, 0 or 1
+    bool white_to_move;
+};
+#pragma pack(pop)
+
+/**
+ * @brief settings from the command line
+ */
+struct Config{
+    std::string positions_path;
+    std::string output_path = "tuned_search_params.h";
+    unsigned thread_count = std::thread::hardware_concurrency();
+    int depth = DEFAULT_DEPTH;
+    size_t max_positions = SIZE_MAX;
+};
+
+const std::string USAGE = "usage: main --positions <labelled fens> [--output <header>] [--threads <count>] [--depth <ply>] [--limit <positions>]\n"
+    "each line holds a fen followed by a result, written as 1-0, 0-1, 1/2-1/2 or [1.0], [0.5], [0.0]";
+
+const std::vector<CommandLine::Flag<Config>> FLAGS = {
+    {"--positions", [](Config& config, const std::string& value){ config.positions_path = value; }},
+    {"--output",    [](Config& config, const std::string& value){ config.output_path = value; }},
+    {"--threads",   [](Config& config, const std::string& value){ config.thread_count = std::max(std::stoi(value), 1); }},
+    {"--depth",     [](Config& config, const std::string& value){ config.depth = std::clamp(std::stoi(value), 0, Engine::MAX_SEARCH_DEPTH); }},
+    {"--limit",     [](Config& config, const std::string& value){ config.max_positions = std::max<size_t>(std::stoull(value), 1); }},
+};
+
+/**
+ * @returns the settings, or nullopt (after printing why) if the arguments are wrong
+ */
+inline std::optional<Config> ParseArguments(int argc, char** argv){
+    Config config;
+    if(!CommandLine::ParseFlags(argc, argv, FLAGS, USAGE, config)){
+        return std::nullopt;
+    }
+
+    if(config.positions_path.empty()){
+        sync_cout << USAGE << std::endl;
+        return std::nullopt;
+    }
+    return config;
+}
+
+/**
+ * @returns the result for white written in the line, or nullopt if there isn't one
+ */
+inline std::optional<int> ParseResult(const std::string& line){
+    if(line.find("1/2-1/2") != std::string::npos || line.find("[0.5]") != std::string::npos){
+        return 0;
+    }
+    if(line.find("1-0") != std::string::npos || line.find("[1.0]") != std::string::npos || line.find("[1]") != std::string::npos){
+        return 1;
+    }
+    if(line.find("0-1") != std::string::npos || line.find("[0.0]") != std::string::npos || line.find("[0]") != std::string::npos){
+        return -1;
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief reads every labelled position that has a result and both kings
+ */
+inline std::vector<TuningPosition> LoadPositions(const std::string& path, size_t max_positions){
+    std::vector<TuningPosition> positions;
+    std::ifstream file(path);
+    Board board;
+    SearchUtils::PlyData ply_data = {};
+    std::string line;
+    while(positions.size() < max_positions && std::getline(file, line)){
+        const std::optional<int> result = ParseResult(line);
+        std::istringstream fields(line);
+        std::string placement, turn;
+        if(!result || !(fields >> placement >> turn) || (turn != "w" && turn != "b")){
+            continue;
+        }
+        StringTools::ReadFEN(placement + " " + turn + " - - 0 1", board, &ply_data);
+        for(bool colour : {false, true}){
+            if(BitboardUtils::PopCount(board.piece_bitboard[PieceUtils::KING] & board.colour_bitboard[colour]) != 1){
+                placement.clear();
+            }
+        }
+        if(placement.empty()){
+            continue;
+        }
+        const std::optional<PackedPosition::PackedDataPoint> packed = PackedPosition::Encode(QuietGen::DataPoint(board, *result));
+        if(packed){
+            positions.push_back({*packed, board.turn});
+        }
+    }
+    return positions;
+}
+
+/**
+ * @brief rebuilds the fen of a tuning position, which has no castling or en passant rights
+ */
+inline std::string ToFEN(const TuningPosition& tuning_position){
+    Piece squares[64];
+    std::fill(std::begin(squares), std::end(squares), PieceUtils::EMPTY);
+    Bitboard remaining = tuning_position.position.occupancy;
+    for(int i=0; remaining; i++){
+        const uint8_t code = (i % 2 == 0) ? (tuning_position.position.pieces[i/2] & 0xF) : (tuning_position.position.pieces[i/2] >> 4);
+        squares[BitboardUtils::FindLSB(remaining)] = code;//the packed piece codes are the engine's pieces
+        remaining &= remaining - 1;
+    }
+
+    std::string fen;
+    for(int rank=7;rank>=0;rank--){
+        int empty_count = 0;
+        for(int file=0;file<8;file++){
+            const Piece p = squares[SquareUtils::FromCoords(file, rank)];
+            if(PieceUtils::IsEmpty(p)){
+                empty_count++;
+                continue;
+            }
+            if(empty_count){
+                fen += std::to_string(empty_count);
+                empty_count = 0;
+            }
+            fen += StringTools::ToLetter(p);
+        }
+        if(empty_count){
+            fen += std::to_string(empty_count);
+        }
+        if(rank){
+            fen += '/';
+        }
+    }
+    return fen + (tuning_position.white_to_move ? " w" : " b") + " - - 0 1";
+}
+
+/**
+ * @brief scores every position on every thread, each with its own worker
+ */
+class ParallelScorer{
+    public:
+    ParallelScorer(unsigned thread_count) {
+        for(unsigned i=0;i<std::max(thread_count, 1u);i++){
+            threads.push_back(std::make_unique<ThreadState>());
+        }
+    }
+
+    /**
+     * @returns the search score of each position from white's point of view
+     */
+    std::vector<Evaluation> Score(const std::vector<TuningPosition>& positions, const SearchParams& params, int depth){
+        std::vector<Evaluation> scores(positions.size());
+        std::vector<std::thread> running;
+        for(size_t t=0;t<threads.size();t++){
+            running.emplace_back([&, t]{
+                Worker& w = *threads[t]->worker;
+                w.SetSearchParams(params);
+                for(size_t i = positions.size() * t / threads.size(); i < positions.size() * (t+1) / threads.size(); i++){
+                    w.current_ply_before_search = w.current_board_search_stack;
+                    w.repetition_table.Clear();
+                    StringTools::ReadFEN(ToFEN(positions[i]), w.current_board, w.current_ply_before_search);
+                    w.transposition_table.ClearTable();//so that each score only depends on its own position
+
+                    const Evaluation score = w.FixedDepthScore(depth);
+                    scores[i] = positions[i].white_to_move ? score : -score;
+                }
+            });
+        }
+        for(std::thread& thread : running){
+            thread.join();
+        }
+        return scores;
+    }
+
+    private:
+    struct ThreadState{
+        std::atomic<bool> stop_flag = false;
+        std::unique_ptr<Worker> worker = std::make_unique<Worker>(stop_flag, WORKER_HASH_MB);
+        ThreadState() {worker->print_info = false;}
+    };
+    std::vector<std::unique_ptr<ThreadState>> threads;
+};
+
+/**
+ * @brief the mean squared error between the expected score of each search score (a logistic curve scaled by k) and the game result
+ */
+inline double MeanSquaredError(const std::vector<TuningPosition>& positions, const std::vector<Evaluation>& scores, double k){
+    double total = 0;
+    for(size_t i=0;i<positions.size();i++){
+        const double result = (PackedPosition::DequantizeScore(positions[i].position.score) + 1) / 2;//0 for a loss, 1 for a win
+        const double clamped_score = std::clamp(scores[i], -Eval::FURTHEST_MATE, Eval::FURTHEST_MATE);
+        const double expected = 1 / (1 + std::pow(10.0, -k * clamped_score / 400));
+        total += (result - expected) * (result - expected);
+    }
+    return total / std::max<size_t>(positions.size(), 1);
+}
+
+/**
+ * @brief finds the logistic scale that best fits the scores, so that the tuning doesn't just rescale the scores
+ */
+inline double FitScale(const std::vector<TuningPosition>& positions, const std::vector<Evaluation>& scores){
+    double k = 1;
+    double best_error = MeanSquaredError(positions, scores, k);
+    for(double step : {0.1, 0.01, 0.001}){
+        for(double direction : {1.0, -1.0}){
+            while(k + direction*step > 0){
+                const double error = MeanSquaredError(positions, scores, k + direction*step);
+                if(error >= best_error){
+                    break;
+                }
+                best_error = error;
+                k += direction*step;
+            }
+        }
+    }
+    return k;
+}
+
+/**
+ * @brief writes the parameters as a header that can replace the SearchParams defaults
+ */
+inline bool WriteHeader(const std::string& path, const SearchParams& params, size_t position_count, int depth, double k, double error){
+    std::ofstream out(path, std::ios::trunc);
+    out << "#pragma once\n\n" <<
+    "#include \"Engine.h\"\n\n" <<
+    "//generated by the tuner from " << position_count << " positions searched to depth " << depth <<
+    ", with a logistic scale of " << k << " and a mean squared error of " << std::setprecision(8) << error << "\n" <<
+    "constexpr SearchParams TUNED_SEARCH_PARAMS = [](){\n" <<
+    "    SearchParams params;\n";
+    for(const TunedParam& tuned : TUNED_PARAMS){
+        out << "    params." << tuned.name << " = " << params.*tuned.param << ";\n";
+    }
+    out << "    return params;\n" <<
+    "}();\n";
+    return out.good();
+}
+
+/**
+ * @brief coordinate descent: steps each parameter up or down while that lowers the error, halving the steps once no step helps
+ * @returns the tuned parameters, which are also written to config.output_path after every pass that improved them
+ */
+inline SearchParams Tune(const std::vector<TuningPosition>& positions, const Config& config){
+    ParallelScorer scorer(config.thread_count);
+    SearchParams params;
+
+    TimePoint start_time = TimePoint();
+    const std::vector<Evaluation> initial_scores = scorer.Score(positions, params, config.depth);
+    const double k = FitScale(positions, initial_scores);
+    double best_error = MeanSquaredError(positions, initial_scores, k);
+    sync_cout << "logistic scale " << k << ", starting error " << std::setprecision(8) << best_error << std::endl;
+
+    std::vector<int> steps;
+    for(const TunedParam& tuned : TUNED_PARAMS){
+        steps.push_back(tuned.initial_step);
+    }
+
+    for(int pass=1; pass<=MAX_PASSES; pass++){
+        bool improved = false;
+        for(size_t i=0;i<TUNED_PARAMS.size();i++){
+            const TunedParam& tuned = TUNED_PARAMS[i];
+            for(int direction : {1, -1}){
+                SearchParams candidate = params;
+                candidate.*tuned.param = std::clamp(params.*tuned.param + direction*steps[i], tuned.min_value, tuned.max_value);
+                if(candidate.*tuned.param == params.*tuned.param){
+                    continue;
+                }
+                const double error = MeanSquaredError(positions, scorer.Score(positions, candidate, config.depth), k);
+                if(error < best_error){
+                    best_error = error;
+                    params = candidate;
+                    improved = true;
+                    break;
+                }
+            }
+        }
+
+        std::ostringstream progress;
+        progress << "pass " << pass << " error " << std::setprecision(8) << best_error << " after " << start_time.HowLongAgo() / 1000 << "s:";
+        for(const TunedParam& tuned : TUNED_PARAMS){
+            progress << " " << tuned.name << " " << params.*tuned.param;
+        }
+        sync_cout << progress.str() << std::endl;
+
+        if(improved){
+            WriteHeader(config.output_path, params, positions.size(), config.depth, k, best_error);
+            continue;
+        }
+        if(std::ranges::all_of(steps, [](int step){return step == 1;})){
+            break;//no single step helps any parameter
+        }
+        for(int& step : steps){
+            step = std::max(step / 2, 1);
+        }
+    }
+
+    WriteHeader(config.output_path, params, positions.size(), config.depth, k, best_error);
+    return params;
+}
+
+} // namespace TexelTuner
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "Board.h"
+#include "MoveGenerator.h"
+#include "threadsafe_io.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief the training data format, and the file helpers shared by every tool that makes or reads training data
+ */
+namespace QuietGen {
+    constexpr size_t DEFAULT_BUFFER_ELEMENTS = 8'064'516;//how many positions ShufflingBufferedWriter shuffles together, roughly every 500MB
+
+    #pragma pack(push,1)//prevent compiler from messing with my struct alignment
+    struct DataPoint {
+        DataPoint() = default;//for reading data points back from a file
+        DataPoint(const Board& board, float tanh_input):
+        tanh_score(tanh_input)
+        {
+            //store colour bitboards
+            colours[0] = board.colour_bitboard[0];
+            colours[1] = board.colour_bitboard[1];
+
+            //store non king bitboards
+            for(Piece p = 0; p < 5; p++){// N B R Q P
+                non_king_pieces[p] = board.piece_bitboard[p];
+            }
+
+            //store king positions
+            for(int i=0;i<2;i++){
+                SetKingPos(board.piece_bitboard[PieceUtils::KING] & board.colour_bitboard[i], i);
+            }
+        }
+        //TODO order these better, but don't mess up the training data
+        float tanh_score;
+        uint8_t king_xy[2];//[colour] upper nibble is x, lower nibble is y
+        Bitboard colours[2];//[colour]
+        Bitboard non_king_pieces[5];//bitboards for non king pieces, indexed [base piece]
+
+        private:
+        void SetKingPos(Bitboard king_bb, bool colour){
+            assert(BitboardUtils::PopCount(king_bb) == 1);
+            Square king_pos = BitboardUtils::FindLSB(king_bb);
+            Square x = SquareUtils::ToFile(king_pos);
+            assert(x < 8);
+            Square y = SquareUtils::ToRank(king_pos);
+            assert(y < 8);
+            king_xy[colour] = (x<<4 | y);
+        }
+    };
+    #pragma pack(pop)
+
+    class ShufflingBufferedWriter {
+        public:
+        ShufflingBufferedWriter(const std::string& path, size_t max_elements, uint64_t seed):
+        out_file(path, std::iostream::binary | std::iostream::trunc),
+        write_buffer(),
+        can_save_training_data(out_file.is_open()),
+        max_elements(max_elements),
+        rng(seed)
+        {
+            write_buffer.reserve(max_elements);
+            assert(write_buffer.size() == 0);
+            assert(write_buffer.capacity() == max_elements);
+        }
+
+        /**
+         * @warning not thread-safe with other writes
+         */
+        void SaveEntry(const DataPoint& dp){
+            entries_saved++;
+            write_buffer.push_back(dp);
+            if(write_buffer.size() == max_elements){
+                ShuffleWrite();
+            }
+        }
+
+        bool CanWrite() const {return can_save_training_data.load();}
+
+        size_t EntriesSaved() const {return entries_saved;}
+
+        /**
+         * @note can be called from multi_threads
+         */
+        void Destruct(){
+            if(can_save_training_data.load() == false){
+                return;//already done
+            }
+            can_save_training_data = false;
+            ShuffleWrite();
+
+            out_file.close();
+        }
+
+        ~ShufflingBufferedWriter(){
+            Destruct();
+        }
+
+        private:
+
+        void ShuffleWrite(){
+            sync_cout << "shuffling segment" << std::endl;
+
+            std::ranges::shuffle(write_buffer, rng);
+
+            out_file.write((const char*)write_buffer.data(), write_buffer.size() * sizeof(DataPoint));//don't ask. it works on my machine...
+
+            write_buffer.clear();
+
+            sync_cout << "done shuffling" << std::endl;
+
+        }
+
+        std::ofstream out_file;
+        std::vector<DataPoint> write_buffer;
+        std::atomic<bool> can_save_training_data;
+        size_t max_elements;
+        size_t entries_saved = 0;
+        std::mt19937_64 rng;//kept between segments, so that each segment is shuffled differently
+    };
+
+    /**
+     * @brief a read only memory mapping of a whole file
+     */
+    class MappedFile {
+        public:
+        MappedFile(const std::string& path): data(nullptr), size(0) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if(fd < 0){
+                return;
+            }
+            struct stat file_info;
+            if(fstat(fd, &file_info) == 0 && file_info.st_size > 0){
+                void* mapping = mmap(nullptr, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapping != MAP_FAILED){
+                    madvise(mapping, file_info.st_size, MADV_SEQUENTIAL);//each worker reads its chunk from start to end
+                    data = static_cast<const char*>(mapping);
+                    size = file_info.st_size;
+                }
+            }
+            close(fd);//the mapping keeps the file open
+        }
+
+        ~MappedFile(){
+            if(data != nullptr){
+                munmap(const_cast<char*>(data), size);
+            }
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool IsOpen() const {return data != nullptr;}
+
+        std::string_view View() const {return std::string_view(data, size);}
+
+        private:
+        const char* data;
+        size_t size;
+    };
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "training_data.h"
+#include "Zobrist.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief shuffles a whole training data file that is too big to fit in memory, merging duplicate positions on the way
+ * @note positions are scattered into bucket files by a seeded hash of their zobrist key, so duplicates always land in the same bucket.
+ * each bucket is then small enough to dedup and shuffle in memory, and the buckets are joined into the output
+ */
+namespace TrainingShuffle {
+
+constexpr size_t SCATTER_BUFFER_ENTRIES = 4096;//per bucket, before it is appended to its file
+
+struct ShuffleStats{
+    size_t positions_read = 0;
+    size_t positions_written = 0;
+};
+
+/**
+ * @brief zobrist key of the pieces in a data point. there is no side to move, so it is left out
+ */
+inline uint64_t PositionKey(const QuietGen::DataPoint& dp){
+    uint64_t key = 0;
+    for(int colour=0;colour<2;colour++){
+        const Piece colour_offset = colour ? PieceUtils::WHITE_FLAG : 0;
+        for(Piece p=0;p<5;p++){
+            Bitboard pieces = dp.non_king_pieces[p] & dp.colours[colour];
+            while(pieces){
+                key ^= Zobrist::GetPieceHash(BitboardUtils::FindLSB(pieces), p + colour_offset);
+                pieces &= pieces - 1;
+            }
+        }
+        const Square king = SquareUtils::FromCoords(dp.king_xy[colour] >> 4, dp.king_xy[colour] & 0xF);
+        key ^= Zobrist::GetPieceHash(king, PieceUtils::KING + colour_offset);
+    }
+    return key;
+}
+
+/**
+ * @returns true if both data points are the same position, ignoring their scores
+ */
+inline bool SamePosition(const QuietGen::DataPoint& a, const QuietGen::DataPoint& b){
+    constexpr size_t position_start = offsetof(QuietGen::DataPoint, king_xy);
+    return std::memcmp(reinterpret_cast<const char*>(&a) + position_start, reinterpret_cast<const char*>(&b) + position_start, sizeof(QuietGen::DataPoint) - position_start) == 0;
+}
+
+/**
+ * @brief splitmix64 finaliser, so that the seed changes which bucket every key goes to
+ */
+inline uint64_t MixKey(uint64_t key, uint64_t seed){
+    uint64_t z = key ^ (seed * 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+inline std::string BucketPath(const std::string& out_path, size_t bucket){
+    return out_path + ".bucket" + std::to_string(bucket);
+}
+
+/**
+ * @brief sorts a bucket by position, replaces each group of duplicates with one data point with their average score, then shuffles it
+ */
+inline void DedupAndShuffle(std::vector<QuietGen::DataPoint>& bucket, std::mt19937_64& rng){
+    std::vector<std::pair<uint64_t, size_t>> order;//key, index
+    order.reserve(bucket.size());
+    for(size_t i=0;i<bucket.size();i++){
+        order.emplace_back(PositionKey(bucket[i]), i);
+    }
+    std::ranges::sort(order);
+
+    std::vector<QuietGen::DataPoint> unique;
+    unique.reserve(bucket.size());
+    std::vector<bool> merged(order.size(), false);//indexed like order
+    for(size_t group_start=0; group_start<order.size();){
+        //every data point with the same key is compared, in case of a key collision
+        size_t group_end = group_start;
+        while(group_end < order.size() && order[group_end].first == order[group_start].first){
+            group_end++;
+        }
+
+        for(size_t i=group_start;i<group_end;i++){
+            if(merged[i]){
+                continue;//already averaged into an earlier data point
+            }
+            const QuietGen::DataPoint& first = bucket[order[i].second];
+            double score_total = 0;
+            int count = 0;
+            for(size_t j=i;j<group_end;j++){
+                if(!merged[j] && SamePosition(first, bucket[order[j].second])){
+                    score_total += bucket[order[j].second].tanh_score;
+                    count++;
+                    merged[j] = true;
+                }
+            }
+            unique.push_back(first);
+            unique.back().tanh_score = score_total / count;
+        }
+        group_start = group_end;
+    }
+
+    std::ranges::shuffle(unique, rng);
+    bucket = std::move(unique);
+}
+
+/**
+ * @brief shuffles the whole of in_path into out_path, merging duplicate positions
+ * @param bucket_positions roughly how many positions are held in memory at once
+ * @param seed the same seed and input always give the same output
+ * @returns the number of positions read and written, or nullopt if a file could not be used
+ */
+inline std::optional<ShuffleStats> ShuffleFile(const std::string& in_path, const std::string& out_path, size_t bucket_positions, uint64_t seed){
+    const QuietGen::MappedFile in_file(in_path);
+    if(!in_file.IsOpen() || in_file.View().size() % sizeof(QuietGen::DataPoint) != 0){
+        sync_cout << in_path << " is missing or is not a whole number of data points" << std::endl;
+        return std::nullopt;
+    }
+
+    const QuietGen::DataPoint* input = reinterpret_cast<const QuietGen::DataPoint*>(in_file.View().data());//packed, so any address is aligned
+    ShuffleStats stats;
+    stats.positions_read = in_file.View().size() / sizeof(QuietGen::DataPoint);
+    const size_t bucket_count = std::max<size_t>((stats.positions_read + bucket_positions - 1) / bucket_positions, 1);
+
+    //scatter every position into a bucket file
+    sync_cout << "scattering " << stats.positions_read << " positions into " << bucket_count << " buckets" << std::endl;
+    {
+        std::vector<std::ofstream> bucket_files;
+        std::vector<std::vector<QuietGen::DataPoint>> scatter_buffers(bucket_count);
+        for(size_t b=0;b<bucket_count;b++){
+            bucket_files.emplace_back(BucketPath(out_path, b), std::ios::binary | std::ios::trunc);
+            if(!bucket_files.back().is_open()){
+                sync_cout << "could not create " << BucketPath(out_path, b) << std::endl;
+                return std::nullopt;
+            }
+            scatter_buffers[b].reserve(SCATTER_BUFFER_ENTRIES);
+        }
+
+        auto flush = [&](size_t b){
+            bucket_files[b].write(reinterpret_cast<const char*>(scatter_buffers[b].data()), scatter_buffers[b].size() * sizeof(QuietGen::DataPoint));
+            scatter_buffers[b].clear();
+        };
+
+        for(size_t i=0;i<stats.positions_read;i++){
+            const size_t b = MixKey(PositionKey(input[i]), seed) % bucket_count;
+            scatter_buffers[b].push_back(input[i]);
+            if(scatter_buffers[b].size() == SCATTER_BUFFER_ENTRIES){
+                flush(b);
+            }
+        }
+        for(size_t b=0;b<bucket_count;b++){
+            flush(b);
+        }
+    }
+
+    //dedup and shuffle each bucket in memory, then append it to the output
+    std::ofstream out_file(out_path, std::ios::binary | std::ios::trunc);
+    if(!out_file.is_open()){
+        sync_cout << "could not write to " << out_path << std::endl;
+        return std::nullopt;
+    }
+    std::mt19937_64 rng(seed);
+    std::vector<QuietGen::DataPoint> bucket;
+    for(size_t b=0;b<bucket_count;b++){
+        const std::string bucket_path = BucketPath(out_path, b);
+        {
+            std::ifstream bucket_file(bucket_path, std::ios::binary | std::ios::ate);
+            const size_t bucket_size = bucket_file.tellg() / sizeof(QuietGen::DataPoint);
+            bucket.resize(bucket_size);
+            bucket_file.seekg(0);
+            bucket_file.read(reinterpret_cast<char*>(bucket.data()), bucket_size * sizeof(QuietGen::DataPoint));
+        }
+        std::remove(bucket_path.c_str());
+
+        DedupAndShuffle(bucket, rng);
+        out_file.write(reinterpret_cast<const char*>(bucket.data()), bucket.size() * sizeof(QuietGen::DataPoint));
+        stats.positions_written += bucket.size();
+    }
+
+    return stats;
+}
+
+} // namespace TrainingShuffle